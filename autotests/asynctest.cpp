@@ -8,14 +8,26 @@
 //krazy:excludeall=crashy
 
 #include "../src/async.h"
+#include "../src/metrics.h"
+#include "../src/shared.h"
+#include "../src/stream.h"
+#include "../src/trace.h"
 
+#include <QHash>
 #include <QObject>
 #include <QString>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QtTest/QTest>
 #include <QDebug>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
+#include <numeric>
+#include <memory>
+#include <thread>
 
 #define COMPARERET(actual, expected, retval) \
 do {\
@@ -54,8 +66,35 @@ private Q_SLOTS:
     void testVoidNestedJob();
     void testAsyncEach();
     void testAsyncSerialEach();
+    void testAsyncBoundedEach();
+    void testMap();
+    void testReduce();
+    void testWhenAll();
+    void testWhenAny();
+    void testStream();
+    void testStreamBackpressure();
+    void testShared();
+    void testProgress();
+    void testThreadPoolScheduler();
+    void testCompletionBatching();
+    void testWorkStealingScheduler();
+    void testConcurrentExec();
+    void testSchedulerWithoutEventLoop();
+    void testExecBatch();
+    void testWaitWithoutEventLoop();
+    void testWaitInThreadPool();
+    void testLongChain();
+    void testCancel();
+    void testCancelLoops();
+    void testTimeout();
+    void testRetry();
+    void testTrace();
+    void testStepStats();
+    void testMetrics();
     void noTemplateArguments();
     void testValueJob();
+    void testMoveOnlyValue();
+    void testValueIsMovedBetweenSteps();
 
     void benchmarkSyncThenExecutor();
     void benchmarkFutureThenExecutor();
@@ -861,6 +900,1459 @@ void AsyncTest::testAsyncSerialEach()
         QVERIFY(future.isFinished());
         QCOMPARE(result, expected);
     }
+    {
+        QVector<int> values(100000);
+        std::iota(values.begin(), values.end(), 0);
+        int running = 0;
+        int maxRunning = 0;
+        int processed = 0;
+        bool inOrder = true;
+        auto future = KAsync::serialForEach<QVector<int>>(
+                KAsync::start<void, int>([&](int i) {
+                    inOrder = inOrder && i == processed;
+                    running++;
+                    maxRunning = std::max(maxRunning, running);
+                    return KAsync::start<void>([&]() {
+                        running--;
+                        processed++;
+                    });
+                })
+            ).exec(values);
+        QVERIFY(future.isFinished());
+        QVERIFY(!future.hasError());
+        QCOMPARE(processed, values.size());
+        QCOMPARE(maxRunning, 1);
+        QVERIFY(inOrder);
+    }
+    {
+        QList<int> result;
+        auto future = job.serialEach([&result](int i) {
+                result << i;
+                if (i == 2) {
+                    return KAsync::error<void>(2, QStringLiteral("Failed"));
+                }
+                return KAsync::wait(1);
+            }).exec();
+        future.waitForFinished();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 2);
+        QCOMPARE(result, expected);
+    }
+}
+
+void AsyncTest::testAsyncBoundedEach()
+{
+    const QList<int> expected({1, 2, 3, 4, 5, 6, 7});
+
+    auto job = KAsync::value<QList<int>>(expected);
+    {
+        QList<int> result;
+        int running = 0;
+        int maxRunning = 0;
+        auto future = job.each([&](int i) {
+                running++;
+                maxRunning = std::max(maxRunning, running);
+                return KAsync::wait(1)
+                    .then([&, i] {
+                        running--;
+                        result << i;
+                    });
+            }, 3).exec();
+        QVERIFY(!future.isFinished());
+        QCOMPARE(running, 3);
+        future.waitForFinished();
+        QVERIFY(future.isFinished());
+        QVERIFY(!future.hasError());
+        QCOMPARE(maxRunning, 3);
+        std::sort(result.begin(), result.end());
+        QCOMPARE(result, expected);
+    }
+
+    //Errors don't stop the processing by default, all of them are reported
+    {
+        QList<int> result;
+        auto future = job.each([&](int i) {
+                result << i;
+                if (i % 2) {
+                    return KAsync::error<void>(i, QStringLiteral("error"));
+                }
+                return KAsync::null<void>();
+            }, 2).exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 1);
+        QCOMPARE(future.errors().size(), 4);
+        QCOMPARE(future.errors().last().errorCode, 7);
+        QCOMPARE(result, expected);
+    }
+
+    //Only up to errorLimit() errors are kept, and they propagate through the chain
+    {
+        KAsync::setErrorLimit(2);
+        auto future = job.each([](int i) {
+                return KAsync::error<void>(i, QStringLiteral("error"));
+            }, 2)
+            .then([] {})
+            .exec();
+        KAsync::setErrorLimit(32);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errors().size(), 2);
+        QCOMPARE(future.errors().first().errorCode, 1);
+        QCOMPARE(future.errors().last().errorCode, 2);
+    }
+
+    //With StopOnError no new values are started after the first error
+    {
+        QList<int> result;
+        auto future = job.each([&](int i) {
+                result << i;
+                if (i == 3) {
+                    return KAsync::error<void>(i, QStringLiteral("error"));
+                }
+                return KAsync::wait(1);
+            }, 2, KAsync::StopOnError).exec();
+        future.waitForFinished();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 3);
+        QCOMPARE(result, QList<int>({1, 2, 3}));
+    }
+}
+
+void AsyncTest::testMap()
+{
+    const QList<int> values({1, 2, 3, 4, 5, 6, 7});
+
+    //Results keep the order of the values, even if the jobs finish out of order
+    {
+        auto future = KAsync::value<QList<int>>(values)
+            .map<QString>([](int i) {
+                return KAsync::wait(10 - i)
+                    .then([i] {
+                        return QString::number(i);
+                    });
+            })
+            .exec();
+        future.waitForFinished();
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), QVector<QString>({QStringLiteral("1"), QStringLiteral("2"), QStringLiteral("3"),
+                                                   QStringLiteral("4"), QStringLiteral("5"), QStringLiteral("6"),
+                                                   QStringLiteral("7")}));
+    }
+
+    //Bounded
+    {
+        int running = 0;
+        int maxRunning = 0;
+        auto future = KAsync::map<QList<int>, int>([&](int i) {
+                running++;
+                maxRunning = std::max(maxRunning, running);
+                return KAsync::wait(1)
+                    .then([&, i] {
+                        running--;
+                        return i * 2;
+                    });
+            }, 2)
+            .exec(values);
+        QVERIFY(!future.isFinished());
+        future.waitForFinished();
+        QCOMPARE(maxRunning, 2);
+        QCOMPARE(future.value(), QVector<int>({2, 4, 6, 8, 10, 12, 14}));
+    }
+
+    //The first error is reported instead of the results
+    {
+        auto future = KAsync::map<QList<int>, int>(KAsync::start<int, int>([](int i, KAsync::Future<int> &f) {
+                if (i % 2 == 0) {
+                    f.setError(i, QStringLiteral("error"));
+                } else {
+                    f.setValue(i);
+                    f.setFinished();
+                }
+            }))
+            .exec(values);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 2);
+    }
+
+    //Empty list
+    {
+        auto future = KAsync::map<QList<int>, int>([](int i) {
+                return KAsync::value(i);
+            })
+            .exec(QList<int>());
+        QVERIFY(future.isFinished());
+        QVERIFY(!future.hasError());
+        QVERIFY(future.value().isEmpty());
+    }
+}
+
+void AsyncTest::testReduce()
+{
+    const QList<int> values({1, 2, 3, 4, 5, 6, 7});
+
+    //Results are combined as the jobs finish
+    {
+        QVector<int> combined;
+        auto future = KAsync::reduce<QList<int>, int, int>([](int i) {
+                return KAsync::wait(10 - i)
+                    .then([i] {
+                        return i * i;
+                    });
+            },
+            0, [&](int sum, int square) {
+                combined << square;
+                return sum + square;
+            })
+            .exec(values);
+        QVERIFY(!future.isFinished());
+        future.waitForFinished();
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 140);
+        QCOMPARE(combined.size(), values.size());
+    }
+
+    //Bounded, with the accumulator of a different type than the results
+    {
+        int running = 0;
+        int maxRunning = 0;
+        auto future = KAsync::value<QList<int>>(values)
+            .then(KAsync::reduce<QList<int>, int, QString>([&](int i) {
+                    running++;
+                    maxRunning = std::max(maxRunning, running);
+                    return KAsync::wait(1)
+                        .then([&, i] {
+                            running--;
+                            return i;
+                        });
+                },
+                QString(), [](QString digits, int i) {
+                    return digits + QString::number(i);
+                }, 1))
+            .exec();
+        future.waitForFinished();
+        QCOMPARE(maxRunning, 1);
+        QCOMPARE(future.value(), QStringLiteral("1234567"));
+    }
+
+    //The first error is reported instead of the accumulator
+    {
+        auto future = KAsync::reduce<QList<int>, int, int>([](int i) {
+                if (i == 3) {
+                    return KAsync::error<int>(i, QStringLiteral("error"));
+                }
+                return KAsync::value(i);
+            },
+            0, [](int sum, int i) {
+                return sum + i;
+            }, 1, KAsync::StopOnError)
+            .exec(values);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 3);
+    }
+}
+
+void AsyncTest::testWhenAll()
+{
+    QList<KAsync::Future<int>> pending;
+    const auto pendingJob = KAsync::start<int>([&](KAsync::Future<int> &future) {
+        pending << future;
+    });
+
+    //Values keep the order of the futures
+    {
+        pending.clear();
+        const QList<KAsync::Future<int>> futures({pendingJob.exec(), pendingJob.exec(), pendingJob.exec()});
+        auto future = KAsync::whenAll(futures).exec();
+        QVERIFY(!future.isFinished());
+        for (int i = pending.size() - 1; i >= 0; --i) {
+            pending[i].setResult(i);
+            QCOMPARE(future.isFinished(), i == 0);
+        }
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), QVector<int>({0, 1, 2}));
+    }
+
+    //The futures may have different types
+    {
+        auto future = KAsync::whenAll(KAsync::value(42).exec(), KAsync::value(QStringLiteral("foo")).exec()).exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.value(), std::make_tuple(42, QStringLiteral("foo")));
+    }
+
+    //The first error is reported once all futures are done
+    {
+        pending.clear();
+        const QList<KAsync::Future<int>> futures({pendingJob.exec(), KAsync::error<int>(2, QStringLiteral("error")).exec()});
+        auto future = KAsync::whenAll(futures).exec();
+        QVERIFY(!future.isFinished());
+        pending.first().setResult(1);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 2);
+    }
+
+    //Void futures, and waitForCompletion() that ignores the errors
+    {
+        QList<KAsync::Future<void>> futures({KAsync::null<void>().exec(), KAsync::error<void>(3, QStringLiteral("error")).exec(),
+                                             KAsync::wait(1).exec()});
+        auto all = KAsync::whenAll(futures).exec();
+        auto completion = KAsync::waitForCompletion(futures).exec();
+        all.waitForFinished();
+        completion.waitForFinished();
+        QCOMPARE(all.errorCode(), 3);
+        QVERIFY(!completion.hasError());
+    }
+
+    //Canceling cancels the pending futures
+    {
+        pending.clear();
+        const QList<KAsync::Future<int>> futures({pendingJob.exec(), KAsync::value(1).exec()});
+        auto future = KAsync::whenAll(futures).exec();
+        future.cancel();
+        QVERIFY(future.isCanceled());
+        QVERIFY(pending.first().isCanceled());
+    }
+}
+
+void AsyncTest::testWhenAny()
+{
+    QList<KAsync::Future<int>> pending;
+    const auto pendingJob = KAsync::start<int>([&](KAsync::Future<int> &future) {
+        pending << future;
+    });
+
+    //The first future to finish wins, the others are canceled
+    {
+        pending.clear();
+        const QList<KAsync::Future<int>> futures({pendingJob.exec(), pendingJob.exec(), pendingJob.exec()});
+        auto future = KAsync::whenAny(futures).exec();
+        QVERIFY(!future.isFinished());
+        pending[1].setResult(42);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.value(), 42);
+        QVERIFY(pending[0].isCanceled());
+        QVERIFY(!pending[1].isCanceled());
+        QVERIFY(pending[2].isCanceled());
+    }
+
+    //An error wins as well
+    {
+        auto future = KAsync::whenAny(QList<KAsync::Future<void>>({KAsync::wait(50).exec(),
+                                                                   KAsync::error<void>(3, QStringLiteral("error")).exec()}))
+            .exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 3);
+    }
+
+    //The futures may have different types, the index tells which one finished
+    {
+        pending.clear();
+        auto future = KAsync::whenAny(pendingJob.exec(), KAsync::value(QStringLiteral("foo")).exec()).exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.value().index(), static_cast<std::size_t>(1));
+        QCOMPARE(std::get<1>(future.value()), QStringLiteral("foo"));
+        QVERIFY(pending.first().isCanceled());
+    }
+
+    {
+        auto future = KAsync::whenAny(QList<KAsync::Future<int>>()).exec();
+        QVERIFY(future.isFinished());
+        QVERIFY(future.hasError());
+    }
+}
+
+void AsyncTest::testStream()
+{
+    KAsync::Stream<int> stream(2);
+    auto write1 = stream.write(1).exec();
+    auto write2 = stream.write(2).exec();
+    auto write3 = stream.write(3).exec();
+    QVERIFY(write1.isFinished());
+    QVERIFY(write2.isFinished());
+    // The buffer is full
+    QVERIFY(!write3.isFinished());
+
+    auto read = stream.read().exec();
+    QVERIFY(read.isFinished());
+    QCOMPARE(*read.value(), 1);
+    QVERIFY(write3.isFinished());
+    QVERIFY(!write3.hasError());
+
+    stream.close();
+    QVERIFY(stream.write(4).exec().hasError());
+
+    QList<int> received;
+    auto future = KAsync::consume<int>([&received](int value) {
+        received << value;
+        return KAsync::null();
+    }).exec(stream);
+    QVERIFY(future.isFinished());
+    QVERIFY(!future.hasError());
+    QCOMPARE(received, (QList<int>{2, 3}));
+
+    // Reading past the end
+    read = stream.read().exec();
+    QVERIFY(read.isFinished());
+    QVERIFY(!read.value());
+}
+
+void AsyncTest::testStreamBackpressure()
+{
+    KAsync::Stream<int> input(4);
+    int written = 0;
+    int consumed = 0;
+    int maxAhead = 0;
+    KAsync::doWhile([&]() {
+        return input.write(written).then([&]() {
+            ++written;
+            maxAhead = std::max(maxAhead, written - consumed);
+            return written < 100 ? KAsync::Continue : KAsync::Break;
+        });
+    }).then([input](const KAsync::Error &error) {
+        input.close(error);
+    }).exec();
+    // The producer is paused once the buffer is full
+    QCOMPARE(written, 4);
+
+    int sum = 0;
+    auto job = KAsync::transform<int, int>([](int value) {
+            return KAsync::value(value * 2);
+        }, 2)
+        .then(KAsync::consume<int>([&](int value) {
+            return KAsync::wait(1).then([&sum, &consumed, value]() {
+                sum += value;
+                ++consumed;
+            });
+        }));
+    auto future = job.exec(input);
+    future.waitForFinished();
+    QVERIFY(!future.hasError());
+    QCOMPARE(written, 100);
+    QCOMPARE(consumed, 100);
+    QCOMPARE(sum, 2 * 4950);
+    // Only the buffers and the values being processed are ahead of the consumer
+    QVERIFY(maxAhead < 16);
+
+    // A failing consumer stops the producer
+    KAsync::Stream<int> stream(1);
+    auto producer = KAsync::doWhile([stream]() {
+        return stream.write(0).then([]() {
+            return KAsync::Continue;
+        });
+    }).exec();
+    QVERIFY(!producer.isFinished());
+    future = KAsync::consume<int>([](int) {
+        return KAsync::error<void>(1, QStringLiteral("failed"));
+    }).exec(stream);
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.errorCode(), 1);
+    QVERIFY(producer.isFinished());
+    QCOMPARE(producer.errorCode(), static_cast<int>(KAsync::CanceledError));
+}
+
+void AsyncTest::testShared()
+{
+    int runs = 0;
+    const auto fetch = [&runs](int value) {
+        return KAsync::wait(10).then([&runs, value]() {
+            ++runs;
+            return value;
+        });
+    };
+
+    // Overlapping executions of a key run the job once
+    {
+        KAsync::SharedJobs<int> jobs;
+        auto first = jobs.job(QStringLiteral("a"), fetch(1)).exec();
+        auto second = jobs.job(QStringLiteral("a"), fetch(2)).exec();
+        auto other = jobs.job(QStringLiteral("b"), fetch(3)).exec();
+        // Canceling one of the waiting executions doesn't stop the job
+        auto canceled = jobs.job(QStringLiteral("a"), fetch(4)).exec();
+        canceled.cancel();
+        first.waitForFinished();
+        second.waitForFinished();
+        other.waitForFinished();
+        QCOMPARE(runs, 2);
+        QCOMPARE(first.value(), 1);
+        QCOMPARE(second.value(), 1);
+        QCOMPARE(other.value(), 3);
+        QVERIFY(canceled.isCanceled());
+
+        // Without a ttl the next execution runs the job again
+        auto future = jobs.job(QStringLiteral("a"), fetch(5)).exec();
+        future.waitForFinished();
+        QCOMPARE(runs, 3);
+        QCOMPARE(future.value(), 5);
+    }
+
+    // The result is kept for the ttl, errors are not
+    {
+        runs = 0;
+        auto job = KAsync::shared(fetch(1), 60000);
+        auto future = job.exec();
+        future.waitForFinished();
+        future = job.exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.value(), 1);
+        QCOMPARE(runs, 1);
+
+        int failures = 0;
+        auto failing = KAsync::shared(KAsync::start<int>([&failures]() {
+            ++failures;
+            return KAsync::error<int>(1, QStringLiteral("failed"));
+        }), 60000);
+        QCOMPARE(failing.exec().errorCode(), 1);
+        QCOMPARE(failing.exec().errorCode(), 1);
+        QCOMPARE(failures, 2);
+    }
+
+    // Canceling all waiting executions cancels the job
+    {
+        runs = 0;
+        auto job = KAsync::shared(fetch(1));
+        auto first = job.exec();
+        auto second = job.exec();
+        first.cancel();
+        second.cancel();
+        QTest::qWait(50);
+        QCOMPARE(runs, 0);
+    }
+}
+
+void AsyncTest::testProgress()
+{
+    // Each step reports half of its progress once exec() has returned
+    const auto halfway = [](KAsync::Future<void> &future) {
+        QTimer::singleShot(0, [future]() mutable {
+            future.setProgress(0.5);
+            QTimer::singleShot(0, [future]() mutable {
+                future.setFinished();
+            });
+        });
+    };
+    auto job = KAsync::start<void>(halfway).then<void>(halfway).progressWeight(3);
+
+    QList<qreal> progress;
+    KAsync::FutureWatcher<void> watcher;
+    connect(&watcher, &KAsync::FutureWatcherBase::futureProgress, [&progress](qreal value) {
+        progress << value;
+    });
+    auto future = job.exec();
+    watcher.setFuture(future);
+    future.waitForFinished();
+    QCOMPARE(progress, (QList<qreal>{0.125, 0.625}));
+
+    // Every finished value of a loop adds to its progress
+    progress.clear();
+    auto loop = KAsync::forEach<QList<int>>(KAsync::start<void, int>([](int, KAsync::Future<void> &future) {
+        QTimer::singleShot(0, [future]() mutable {
+            future.setFinished();
+        });
+    }));
+    future = loop.exec(QList<int>{1, 2, 3, 4});
+    watcher.setFuture(future);
+    future.waitForFinished();
+    QCOMPARE(progress, (QList<qreal>{0.25, 0.5, 0.75, 1.0}));
+
+    // Frequent updates are coalesced
+    KAsync::setProgressInterval(50);
+    progress.clear();
+    KAsync::Future<void> pending;
+    future = KAsync::start<void>([&pending](KAsync::Future<void> &future) {
+        pending = future;
+    }).exec();
+    watcher.setFuture(future);
+    for (int i = 1; i <= 10; ++i) {
+        pending.setProgress(i, 10);
+    }
+    QCOMPARE(progress, (QList<qreal>{0.1}));
+    QTRY_COMPARE(progress, (QList<qreal>{0.1, 1.0}));
+    pending.setFinished();
+    KAsync::setProgressInterval(0);
+}
+
+void AsyncTest::testThreadPoolScheduler()
+{
+    KAsync::ThreadPoolScheduler scheduler;
+    QThread * const mainThread = QThread::currentThread();
+    QThread *startThread = nullptr;
+    QThread *workerThread = nullptr;
+    QThread *continuationThread = nullptr;
+
+    auto job = KAsync::start<int>(&scheduler,
+        [&]() {
+            startThread = QThread::currentThread();
+            return 40;
+        })
+        .then<int, int>([&](int value) {
+            workerThread = QThread::currentThread();
+            return value + 2;
+        }).on(&scheduler)
+        .then<int, int>([&](int value) {
+            continuationThread = QThread::currentThread();
+            return value + 1;
+        });
+
+    auto future = job.exec();
+    future.waitForFinished();
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.value(), 43);
+    QVERIFY(startThread != mainThread);
+    QVERIFY(workerThread != mainThread);
+    QCOMPARE(continuationThread, mainThread);
+}
+
+void AsyncTest::testCompletionBatching()
+{
+    KAsync::setCompletionBatching(true);
+
+    // Following steps wait for the run queue instead of running right away
+    int steps = 0;
+    auto job = KAsync::start<int>([&]() {
+            ++steps;
+            return 40;
+        })
+        .then<int, int>([&](int value) {
+            ++steps;
+            return value + 2;
+        });
+    auto future = job.exec();
+    QCOMPARE(steps, 1);
+    QVERIFY(!future.isFinished());
+    future.waitForFinished();
+    QCOMPARE(steps, 2);
+    QCOMPARE(future.value(), 42);
+
+    // Results of a scheduler are delivered through the run queue as well
+    KAsync::ThreadPoolScheduler scheduler;
+    QThread * const mainThread = QThread::currentThread();
+    QThread *continuationThread = nullptr;
+    QList<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values << i;
+    }
+    auto sum = KAsync::reduce<QList<int>, int, int>(KAsync::start<int, int>(&scheduler, [](int value) {
+                return value;
+            }),
+            0, [&](int acc, int value) {
+                continuationThread = QThread::currentThread();
+                return acc + value;
+            })
+        .exec(values);
+    sum.waitForFinished();
+    QCOMPARE(sum.value(), 499500);
+    QCOMPARE(continuationThread, mainThread);
+
+    // Pool threads never process the drain event, their steps run right away
+    QThreadPool pool;
+    KAsync::ThreadPoolScheduler poolScheduler(&pool);
+    std::atomic<bool> finishedInExec{false};
+    poolScheduler.schedule([&]() {
+        finishedInExec = job.exec().isFinished();
+    });
+    QVERIFY(pool.waitForDone(5000));
+    QVERIFY(finishedInExec);
+
+    KAsync::setCompletionBatching(false);
+}
+
+void AsyncTest::testWorkStealingScheduler()
+{
+    KAsync::WorkStealingScheduler scheduler(4);
+    QCOMPARE(scheduler.threadCount(), 4);
+
+    QVector<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values << i;
+    }
+
+    // Results keep the order of the values, whichever worker computed them
+    QThread * const mainThread = QThread::currentThread();
+    QThread *continuationThread = nullptr;
+    auto future = KAsync::parallelMap<QVector<int>, qint64>(&scheduler, [](const int &value) {
+            // Uneven work, the last values take far longer than the first ones
+            qint64 result = 0;
+            for (int i = 0; i <= value * 10; ++i) {
+                result += i % 7;
+            }
+            return result + value;
+        }, 8)
+        .then([&](const QVector<qint64> &results) {
+            continuationThread = QThread::currentThread();
+            return results;
+        })
+        .exec(values);
+    future.waitForFinished();
+    QVERIFY(!future.hasError());
+    QCOMPARE(future.value().size(), values.size());
+    for (int i = 0; i < values.size(); ++i) {
+        qint64 expected = 0;
+        for (int j = 0; j <= i * 10; ++j) {
+            expected += j % 7;
+        }
+        QCOMPARE(future.value()[i], expected + i);
+    }
+    QCOMPARE(continuationThread, mainThread);
+
+    // Every value is processed exactly once
+    std::atomic<int> processed{0};
+    std::atomic<qint64> sum{0};
+    auto loop = KAsync::parallelForEach<QVector<int>>(&scheduler, [&](const int &value) {
+            ++processed;
+            sum += value;
+        })
+        .exec(values);
+    loop.waitForFinished();
+    QCOMPARE(processed.load(), 1000);
+    QCOMPARE(sum.load(), qint64(499500));
+
+    // Empty lists finish right away
+    auto empty = KAsync::parallelForEach<QVector<int>>(&scheduler, [](const int &) {}).exec(QVector<int>());
+    QVERIFY(empty.isFinished());
+}
+
+void AsyncTest::testMoveOnlyValue()
+{
+    auto job = KAsync::start<std::unique_ptr<int>, std::unique_ptr<int>>(
+        [](std::unique_ptr<int> value) {
+            *value += 1;
+            return value;
+        })
+        .then<std::unique_ptr<int>, std::unique_ptr<int>>([](std::unique_ptr<int> value) {
+            return KAsync::start<std::unique_ptr<int>>([v = value.release()]() {
+                return std::unique_ptr<int>(v);
+            });
+        })
+        .then<std::unique_ptr<int>, std::unique_ptr<int>>([](std::unique_ptr<int> value) {
+            *value *= 2;
+            return value;
+        });
+
+    auto future = job.exec(std::make_unique<int>(20));
+    QVERIFY(future.isFinished());
+    QCOMPARE(*future.value(), 42);
+    auto value = future.takeValue();
+    QCOMPARE(*value, 42);
+    QVERIFY(!future.value());
+}
+
+void AsyncTest::testValueIsMovedBetweenSteps()
+{
+    struct CopyCounter {
+        CopyCounter() = default;
+        CopyCounter(const CopyCounter &other) : copies(other.copies + 1) {}
+        CopyCounter(CopyCounter &&other) = default;
+        CopyCounter &operator=(const CopyCounter &other) { copies = other.copies + 1; return *this; }
+        CopyCounter &operator=(CopyCounter &&other) = default;
+        int copies = 0;
+    };
+
+    auto job = KAsync::start<CopyCounter, CopyCounter>(
+        [](CopyCounter value) {
+            return value;
+        })
+        .then<CopyCounter, CopyCounter>([](CopyCounter value) {
+            return value;
+        })
+        .then<CopyCounter, CopyCounter>([](CopyCounter value, KAsync::Future<CopyCounter> &future) {
+            future.setResult(std::move(value));
+        });
+
+    auto future = job.exec(CopyCounter{});
+    QVERIFY(future.isFinished());
+    QCOMPARE(future->copies, 0);
+}
+
+void AsyncTest::testConcurrentExec()
+{
+    const auto job = KAsync::start<int, int>(
+        [](int value) {
+            return value + 1;
+        })
+        .then<int, int>([](int value) {
+            return value * 2;
+        });
+
+    QThreadPool pool;
+    KAsync::ThreadPoolScheduler scheduler(&pool);
+    QAtomicInt failures = 0;
+    for (int i = 0; i < 8; ++i) {
+        scheduler.schedule([&job, &failures, i]() {
+            for (int j = 0; j < 100; ++j) {
+                const int input = i * 100 + j;
+                auto future = job.exec(input);
+                if (!future.isFinished() || future.value() != (input + 1) * 2) {
+                    failures.ref();
+                }
+            }
+        });
+    }
+    pool.waitForDone();
+    QCOMPARE(failures.loadAcquire(), 0);
+
+    // The job is left untouched and can still be executed
+    QCOMPARE(job.exec(20).value(), 42);
+}
+
+void AsyncTest::testSchedulerWithoutEventLoop()
+{
+    // Pool threads have an event dispatcher but never run it, the results of
+    // the scheduler have to be delivered without it
+    KAsync::ThreadPoolScheduler scheduler;
+    const auto job = KAsync::start<int, int>([](int value) {
+            return value + 1;
+        })
+        .on(&scheduler)
+        .then<int, int>([](int value) {
+            return value * 2;
+        });
+
+    QThreadPool pool;
+    KAsync::ThreadPoolScheduler poolScheduler(&pool);
+    std::atomic<int> result{0};
+    std::atomic<int> sum{0};
+    poolScheduler.schedule([&]() {
+        auto future = job.exec(20);
+        if (future.waitFor(5000)) {
+            result = future.value();
+        }
+        auto map = KAsync::parallelMap<QVector<int>, int>(&scheduler, [](const int &value) {
+                return value * 2;
+            })
+            .exec(QVector<int>({1, 2, 3}));
+        if (map.waitFor(5000)) {
+            sum = std::accumulate(map.value().cbegin(), map.value().cend(), 0);
+        }
+    });
+    QVERIFY(pool.waitForDone(15000));
+    QCOMPARE(result.load(), 42);
+    QCOMPARE(sum.load(), 12);
+}
+
+void AsyncTest::testExecBatch()
+{
+    const QList<int> inputs({1, 2, 3, 4, 5, 6, 7});
+
+    //Results keep the order of the inputs, at most maxConcurrency run at a time
+    {
+        int running = 0;
+        int maxRunning = 0;
+        auto job = KAsync::start<int, int>([&](int value) {
+                running++;
+                maxRunning = std::max(maxRunning, running);
+                return KAsync::wait(10 - value).then([&running, value]() {
+                    running--;
+                    return value * 2;
+                });
+            })
+            .then<int, int>([](int value) {
+                return value + 1;
+            });
+        auto future = job.execBatch(inputs, {3});
+        QVERIFY(!future.isFinished());
+        future.waitForFinished();
+        QVERIFY(!future.hasError());
+        QCOMPARE(maxRunning, 3);
+        QCOMPARE(future.value(), QVector<int>({3, 5, 7, 9, 11, 13, 15}));
+    }
+
+    //Synchronous jobs finish within the call, errors of all inputs are reported
+    {
+        auto job = KAsync::start<void, int>([](int value) {
+                if (value % 2) {
+                    return KAsync::error<void>(value, QStringLiteral("error"));
+                }
+                return KAsync::null<void>();
+            });
+        auto future = job.execBatch(inputs);
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errors().size(), 4);
+        QCOMPARE(future.errorCode(), 1);
+
+        KAsync::BatchOptions options;
+        options.maxConcurrency = 1;
+        options.errorPolicy = KAsync::StopOnError;
+        future = job.execBatch(inputs, options);
+        QCOMPARE(future.errors().size(), 1);
+    }
+
+    //Canceling the batch cancels the running executions
+    {
+        int finished = 0;
+        auto job = KAsync::start<void, int>([](int value) {
+                return KAsync::wait(value * 10);
+            })
+            .then([&finished]() {
+                finished++;
+            });
+        auto future = job.execBatch(inputs);
+        future.cancel();
+        QTest::qWait(100);
+        QCOMPARE(finished, 0);
+    }
+
+    //Empty batches finish right away
+    {
+        auto future = KAsync::start<int, int>([](int value) {
+                return value;
+            }).execBatch(QList<int>());
+        QVERIFY(future.isFinished());
+        QVERIFY(future.value().isEmpty());
+    }
+}
+
+void AsyncTest::testWaitWithoutEventLoop()
+{
+    KAsync::Future<int> pending;
+    auto future = KAsync::start<int>([&pending](KAsync::Future<int> &future) {
+        pending = future;
+    }).then([](int value) {
+        return value + 1;
+    }).exec();
+
+    QVERIFY(!future.waitFor(10));
+    QVERIFY(!future.isFinished());
+
+    // The waiting thread has no event loop
+    std::atomic<bool> finished{false};
+    std::thread waiter([&future, &finished]() {
+        future.wait();
+        finished = true;
+    });
+    QThread::msleep(10);
+    QVERIFY(!finished);
+    pending.setResult(41);
+    waiter.join();
+    QVERIFY(finished);
+    QCOMPARE(future.value(), 42);
+
+    // Returns right away once finished
+    QVERIFY(future.waitFor(0));
+    future.wait();
+}
+
+void AsyncTest::testWaitInThreadPool()
+{
+    // Pool threads have an event dispatcher that never runs, waiting there
+    // must not depend on deadlines or batched completions of that thread
+    KAsync::setCompletionBatching(true);
+    QThreadPool pool;
+    KAsync::ThreadPoolScheduler poolScheduler(&pool);
+    std::atomic<int> attempts{0};
+    std::atomic<int> result{0};
+    std::atomic<bool> timedOut{false};
+    poolScheduler.schedule([&]() {
+        auto future = KAsync::start<int>([&]() {
+                if (++attempts < 3) {
+                    return KAsync::error<int>(1, QStringLiteral("error"));
+                }
+                return KAsync::value(41);
+            })
+            .retry(5, {10, 1.0, 10, 0.0})
+            .timeout(1000)
+            .then<int, int>([](int value) {
+                return value + 1;
+            })
+            .exec();
+        if (future.waitFor(5000)) {
+            result = future.value();
+        } else {
+            timedOut = true;
+        }
+    });
+    QVERIFY(pool.waitForDone(10000));
+    KAsync::setCompletionBatching(false);
+    QVERIFY(!timedOut);
+    QCOMPARE(attempts.load(), 3);
+    QCOMPARE(result.load(), 42);
+}
+
+void AsyncTest::testLongChain()
+{
+    // Neither setting up nor destroying the chain may recurse per step
+    const int steps = 100000;
+    auto job = KAsync::start<int>([]() {
+        return 0;
+    });
+    for (int i = 0; i < steps; ++i) {
+        job = job.then<int, int>([](int value) {
+            return value + 1;
+        });
+    }
+
+    {
+        auto future = job.exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.value(), steps);
+    }
+
+    // Releases the executor chain
+    job = KAsync::value(0);
+    QCOMPARE(job.exec().value(), 0);
+}
+
+void AsyncTest::testCancel()
+{
+    {
+        bool abortCalled = false;
+        bool nextCalled = false;
+        bool errorHandlerCalled = false;
+        KAsync::Future<void> pending;
+        auto future = KAsync::start<void>([&](KAsync::Future<void> &future) {
+                pending = future;
+                future.onCanceled([&]() {
+                    abortCalled = true;
+                });
+            })
+            .then<void>([&]() {
+                nextCalled = true;
+            })
+            .onError([&](const KAsync::Error &) {
+                errorHandlerCalled = true;
+            })
+            .exec();
+        QVERIFY(!pending.isFinished());
+        QVERIFY(!future.isFinished());
+
+        future.cancel();
+        QVERIFY(abortCalled);
+        QVERIFY(pending.isFinished());
+        QVERIFY(pending.isCanceled());
+        QVERIFY(future.isFinished());
+        QVERIFY(future.isCanceled());
+        QCOMPARE(future.errorCode(), static_cast<int>(KAsync::CanceledError));
+        QVERIFY(!nextCalled);
+        QVERIFY(!errorHandlerCalled);
+    }
+
+    {
+        // The timer of wait() is stopped, and the nested job is canceled as well
+        bool nestedCalled = false;
+        auto future = KAsync::start<void>([&]() {
+                return KAsync::wait(50).then<void>([&]() {
+                    nestedCalled = true;
+                });
+            })
+            .exec();
+        QVERIFY(!future.isFinished());
+        future.cancel();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), static_cast<int>(KAsync::CanceledError));
+        QTest::qWait(100);
+        QVERIFY(!nestedCalled);
+    }
+
+    {
+        // Canceling a finished future has no effect
+        auto future = KAsync::value(42).exec();
+        QVERIFY(future.isFinished());
+        future.cancel();
+        QVERIFY(!future.isCanceled());
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 42);
+    }
+}
+
+void AsyncTest::testCancelLoops()
+{
+    {
+        QList<KAsync::Future<void> *> pending;
+        int canceledChildren = 0;
+        auto future = KAsync::forEach<QList<int>>(KAsync::start<void, int>([&](int, KAsync::Future<void> &future) {
+                pending << &future;
+                future.onCanceled([&]() {
+                    canceledChildren++;
+                });
+            }), 2).exec(QList<int>({1, 2, 3, 4, 5, 6}));
+        QCOMPARE(pending.size(), 2);
+        pending.takeFirst()->setFinished();
+        QCOMPARE(pending.size(), 2);
+
+        future.cancel();
+        QVERIFY(future.isFinished());
+        QVERIFY(future.isCanceled());
+        QCOMPARE(canceledChildren, 2);
+        // No further values are processed
+        QCOMPARE(pending.size(), 2);
+    }
+
+    {
+        int iterations = 0;
+        auto future = KAsync::doWhile([&]() {
+                iterations++;
+                return KAsync::wait(1).then<KAsync::ControlFlowFlag>([]() {
+                    return KAsync::Continue;
+                });
+            }).exec();
+        QTRY_VERIFY(iterations > 2);
+        future.cancel();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), static_cast<int>(KAsync::CanceledError));
+        const int canceledAt = iterations;
+        QTest::qWait(20);
+        QCOMPARE(iterations, canceledAt);
+    }
+}
+
+void AsyncTest::testTimeout()
+{
+    {
+        bool abortCalled = false;
+        bool nextCalled = false;
+        auto future = KAsync::start<void>([&](KAsync::Future<void> &future) {
+                future.onCanceled([&]() {
+                    abortCalled = true;
+                });
+            })
+            .timeout(10)
+            .then<void>([&]() {
+                nextCalled = true;
+            })
+            .exec();
+        QVERIFY(!future.isFinished());
+        QTRY_VERIFY(future.isFinished());
+        QVERIFY(abortCalled);
+        QVERIFY(!nextCalled);
+        QCOMPARE(future.errorCode(), static_cast<int>(KAsync::TimeoutError));
+    }
+
+    {
+        // The following jobs can handle the TimeoutError
+        KAsync::Error handledError;
+        auto future = KAsync::start<void>([](KAsync::Future<void> &) {})
+            .timeout(10)
+            .onError([&](const KAsync::Error &error) {
+                handledError = error;
+            })
+            .then<int>([]() {
+                return 42;
+            })
+            .exec();
+        QTRY_VERIFY(future.isFinished());
+        QCOMPARE(handledError.errorCode, static_cast<int>(KAsync::TimeoutError));
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 42);
+    }
+
+    {
+        // A job that finishes in time doesn't affect the rest of the chain
+        bool nextCalled = false;
+        auto future = KAsync::wait(1)
+            .timeout(20)
+            .then(KAsync::wait(50))
+            .then<void>([&]() {
+                nextCalled = true;
+            })
+            .exec();
+        QTRY_VERIFY(future.isFinished());
+        QVERIFY(!future.hasError());
+        QVERIFY(nextCalled);
+    }
+
+    {
+        // The timeout of a job continuation covers the whole nested chain
+        bool nestedCalled = false;
+        auto future = KAsync::start<void>([&]() {
+                return KAsync::wait(10)
+                    .then(KAsync::wait(100))
+                    .then<void>([&]() {
+                        nestedCalled = true;
+                    });
+            })
+            .timeout(30)
+            .exec();
+        QTRY_VERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), static_cast<int>(KAsync::TimeoutError));
+        QTest::qWait(150);
+        QVERIFY(!nestedCalled);
+    }
+
+    {
+        // A job finished by another thread keeps its result
+        auto future = KAsync::start<int>([](KAsync::Future<int> &future) {
+                std::thread([future]() mutable {
+                    future.setResult(42);
+                }).detach();
+            })
+            .timeout(30)
+            .exec();
+        QTRY_VERIFY(future.isFinished());
+        QTest::qWait(50);
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 42);
+    }
+
+    {
+        // Concurrent deadlines share one timer
+        QList<KAsync::Future<void>> futures;
+        for (int i = 0; i < 10; ++i) {
+            futures << KAsync::start<void>([](KAsync::Future<void> &) {})
+                .timeout(5 * (10 - i))
+                .exec();
+        }
+        QTRY_VERIFY(std::all_of(futures.cbegin(), futures.cend(), [](const KAsync::Future<void> &f) {
+            return f.isFinished();
+        }));
+        for (const auto &future : futures) {
+            QCOMPARE(future.errorCode(), static_cast<int>(KAsync::TimeoutError));
+        }
+    }
+}
+
+void AsyncTest::testRetry()
+{
+    //The same job is executed again until it succeeds
+    {
+        int attempts = 0;
+        auto future = KAsync::start<int, int>([&](int input) {
+                attempts++;
+                if (attempts < 3) {
+                    return KAsync::error<int>(attempts, QStringLiteral("error"));
+                }
+                return KAsync::value(input * 2);
+            })
+            .retry(5, {1, 2.0, 10, 0.5})
+            .exec(21);
+        future.waitForFinished();
+        QVERIFY(!future.hasError());
+        QCOMPARE(future.value(), 42);
+        QCOMPARE(attempts, 3);
+    }
+
+    //The last error is reported once all attempts have failed
+    {
+        int attempts = 0;
+        auto future = KAsync::start<void>([&]() {
+                attempts++;
+                return KAsync::error<void>(attempts, QStringLiteral("error"));
+            })
+            .retry(3, {0, 1.0, 0, 0.0})
+            .exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 3);
+        QCOMPARE(attempts, 3);
+    }
+
+    //Errors rejected by the predicate are not retried
+    {
+        int attempts = 0;
+        auto future = KAsync::start<void>([&]() {
+                attempts++;
+                return KAsync::error<void>(attempts, QStringLiteral("error"));
+            })
+            .retry(3, {}, [](const KAsync::Error &error) {
+                return error.errorCode != 1;
+            })
+            .exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 1);
+        QCOMPARE(attempts, 1);
+    }
+
+    //Canceling stops the pending delay
+    {
+        int attempts = 0;
+        auto future = KAsync::start<void>([&]() {
+                attempts++;
+                return KAsync::error<void>(attempts, QStringLiteral("error"));
+            })
+            .retry(3, {20, 1.0, 20, 0.0})
+            .exec();
+        QVERIFY(!future.isFinished());
+        future.cancel();
+        QVERIFY(future.isCanceled());
+        QTest::qWait(50);
+        QCOMPARE(attempts, 1);
+    }
+
+    //A cancel from another thread can't remove the delay, but no attempt follows
+    {
+        int attempts = 0;
+        auto future = KAsync::start<void>([&]() {
+                attempts++;
+                return KAsync::error<void>(attempts, QStringLiteral("error"));
+            })
+            .retry(3, {20, 1.0, 20, 0.0})
+            .exec();
+        std::thread thread([&future]() {
+            future.cancel();
+        });
+        thread.join();
+        QVERIFY(future.isCanceled());
+        QTest::qWait(50);
+        QCOMPARE(attempts, 1);
+    }
+
+    //All errors of the last attempt are reported
+    {
+        auto future = KAsync::start<void>([](KAsync::Future<void> &future) {
+                future.setErrors({KAsync::Error(1, QStringLiteral("first")), KAsync::Error(2, QStringLiteral("second"))});
+            })
+            .retry(2, {0, 1.0, 0, 0.0})
+            .exec();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errors().size(), 2);
+        QCOMPARE(future.errors().at(1).errorCode, 2);
+    }
+
+    //Without an event loop the delays are skipped instead of waiting forever
+    {
+        int attempts = 0;
+        KAsync::Future<void> future;
+        std::thread thread([&]() {
+            future = KAsync::start<void>([&]() {
+                    attempts++;
+                    return KAsync::error<void>(attempts, QStringLiteral("error"));
+                })
+                .retry(3, {20, 1.0, 20, 0.0})
+                .exec();
+        });
+        thread.join();
+        QVERIFY(future.isFinished());
+        QCOMPARE(future.errorCode(), 3);
+        QCOMPARE(attempts, 3);
+    }
+
+    //The delays grow exponentially up to the maximum, reduced by up to the jitter
+    {
+        const KAsync::BackoffPolicy backoff{100, 2.0, 1000, 0.5};
+        for (int attempt = 1; attempt < 10; ++attempt) {
+            const int expected = std::min(100 << (attempt - 1), 1000);
+            const int delay = backoff.delay(attempt);
+            QVERIFY(delay <= expected);
+            QVERIFY(delay >= expected / 2);
+        }
+        QCOMPARE((KAsync::BackoffPolicy{100, 2.0, 1000, 0.0}).delay(3), 400);
+    }
+}
+
+void AsyncTest::testTrace()
+{
+    QVector<KAsync::TraceEvent> events;
+    KAsync::setTraceCallback([&events](const KAsync::TraceEvent &event) {
+        events << event;
+    });
+
+    auto job = KAsync::start<int>(
+        []() {
+            return KAsync::start<int>([]() {
+                return 42;
+            });
+        })
+        .then<int, int>([](int value) {
+            return value + 1;
+        });
+    auto future = job.exec();
+    KAsync::setTraceCallback({});
+
+    QCOMPARE(future.value(), 43);
+    // Both steps of the job, and the nested job with the step that forwards its result
+    QCOMPARE(events.size(), 8);
+
+    QHash<quint64, KAsync::TraceEvent> begins;
+    for (const auto &event : qAsConst(events)) {
+        QVERIFY(event.executionId != 0);
+        QVERIFY(event.name);
+        if (event.type == KAsync::TraceEvent::Begin) {
+            QVERIFY(!begins.contains(event.executionId));
+            begins.insert(event.executionId, event);
+        } else {
+            QVERIFY(begins.contains(event.executionId));
+            QVERIFY(begins.value(event.executionId).timestamp <= event.timestamp);
+        }
+    }
+
+    // The nested step started second, within the first step
+    const auto outer = events.at(0);
+    const auto nested = events.at(1);
+    QCOMPARE(outer.type, KAsync::TraceEvent::Begin);
+    QCOMPARE(outer.parentId, quint64(0));
+    QCOMPARE(nested.type, KAsync::TraceEvent::Begin);
+    QCOMPARE(nested.parentId, outer.executionId);
+
+    // Nothing is reported once the callback is removed
+    job.exec();
+    QCOMPARE(events.size(), 8);
+}
+
+static thread_local quint64 sTestAllocated = 0;
+
+void AsyncTest::testStepStats()
+{
+    QVector<KAsync::StepStats> stats;
+    KAsync::setStepStatsCallback([&stats](const KAsync::StepStats &step) {
+        stats << step;
+    });
+    KAsync::setAllocationCounter([]() {
+        return sTestAllocated;
+    });
+
+    KAsync::Future<int> pending;
+    auto job = KAsync::start<int>([&pending](KAsync::Future<int> &future) {
+            pending = future;
+        })
+        .then<int, int>([](int value) {
+            sTestAllocated += 100;
+            return value + 1;
+        });
+    auto future = job.exec();
+    QTest::qSleep(20);
+    pending.setResult(41);
+    KAsync::setStepStatsCallback({});
+    KAsync::setAllocationCounter(nullptr);
+
+    QCOMPARE(future.value(), 42);
+    QCOMPARE(stats.size(), 2);
+    for (const auto &step : qAsConst(stats)) {
+        QVERIFY(step.name);
+        QVERIFY(step.queueWait >= 0);
+        QCOMPARE(step.threadId, QThread::currentThreadId());
+    }
+    // The first step was busy until its future was finished, the second one
+    // was only waiting for it
+    QVERIFY(stats.at(0).runTime >= 20 * 1000 * 1000);
+    QCOMPARE(stats.at(0).allocatedBytes, qint64(0));
+    QVERIFY(stats.at(1).runTime < 20 * 1000 * 1000);
+    QCOMPARE(stats.at(1).allocatedBytes, qint64(100));
+
+    // Nothing is reported once the callback is removed
+    job.exec();
+    QCOMPARE(stats.size(), 2);
+}
+
+void AsyncTest::testMetrics()
+{
+    const QString name = QStringLiteral("testMetrics");
+    QCOMPARE(KAsync::jobMetrics(name).executions, quint64(0));
+
+    KAsync::Future<void> pending;
+    auto job = KAsync::start<void, bool>([&pending](bool fail, KAsync::Future<void> &future) {
+        if (fail) {
+            future.setError(1, QStringLiteral("error"));
+        } else {
+            pending = future;
+        }
+    }).name(name);
+
+    job.exec(true);
+    job.exec(false);
+
+    auto metrics = KAsync::jobMetrics(name);
+    QCOMPARE(metrics.name, name);
+    QCOMPARE(metrics.executions, quint64(1));
+    QCOMPARE(metrics.errors, quint64(1));
+    QCOMPARE(metrics.inFlight, qint64(1));
+
+    pending.setFinished();
+    metrics = KAsync::jobMetrics(name);
+    QCOMPARE(metrics.executions, quint64(2));
+    QCOMPARE(metrics.errors, quint64(1));
+    QCOMPARE(metrics.inFlight, qint64(0));
+    QCOMPARE(metrics.latencyHistogram.size(), KAsync::JobMetrics::HistogramBuckets);
+    QCOMPARE(std::accumulate(metrics.latencyHistogram.cbegin(), metrics.latencyHistogram.cend(), quint64(0)), quint64(2));
+
+    const auto all = KAsync::jobMetrics();
+    QVERIFY(std::any_of(all.cbegin(), all.cend(), [&name](const KAsync::JobMetrics &m) {
+        return m.name == name;
+    }));
 }
 
 void AsyncTest::benchmarkSyncThenExecutor()
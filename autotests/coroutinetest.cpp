@@ -0,0 +1,155 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+// Krazy mistakes job.exec() for QDialog::exec() and urges us to use QPointer
+//krazy:excludeall=crashy
+
+#include "../src/coroutine.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QtTest/QTest>
+
+namespace {
+
+KAsync::Job<int> delayedValue(int value)
+{
+    return KAsync::start<int>([value](KAsync::Future<int> &future) {
+        QTimer::singleShot(10, [future, value]() mutable {
+            future.setResult(value);
+        });
+    });
+}
+
+KAsync::Task<int> sum(int count)
+{
+    int sum = 0;
+    for (int i = 1; i <= count; ++i) {
+        sum += co_await delayedValue(i);
+    }
+    co_return sum;
+}
+
+KAsync::Task<int> failing(bool *resumed)
+{
+    co_await KAsync::error<void>({42, "failed"});
+    *resumed = true;
+    co_return 0;
+}
+
+} // namespace
+
+class CoroutineTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testAwaitJob();
+    void testAwaitFuture();
+    void testAwaitTask();
+    void testError();
+    void testSettled();
+    void testCancel();
+    void testExecuteOnce();
+};
+
+void CoroutineTest::testAwaitJob()
+{
+    KAsync::Job<int> job = sum(4);
+    auto future = job.then([](int value) {
+        return value * 2;
+    }).exec();
+    future.waitForFinished();
+    QVERIFY(!future.hasError());
+    QCOMPARE(future.value(), 20);
+}
+
+void CoroutineTest::testAwaitFuture()
+{
+    auto pending = delayedValue(21).exec();
+    KAsync::Job<int> job = [](KAsync::Future<int> future) -> KAsync::Task<int> {
+        co_return co_await future * 2;
+    }(pending);
+
+    auto future = job.exec();
+    QVERIFY(!future.isFinished());
+    future.waitForFinished();
+    QCOMPARE(future.value(), 42);
+    // Awaiting a future does not take its value
+    QCOMPARE(pending.value(), 21);
+}
+
+void CoroutineTest::testAwaitTask()
+{
+    KAsync::Job<int> job = []() -> KAsync::Task<int> {
+        const int first = co_await sum(2);
+        const int second = co_await sum(3);
+        co_return first + second;
+    }();
+
+    auto future = job.exec();
+    future.waitForFinished();
+    QCOMPARE(future.value(), 9);
+}
+
+void CoroutineTest::testError()
+{
+    bool resumed = false;
+    KAsync::Job<int> job = failing(&resumed);
+
+    auto future = job.exec();
+    QVERIFY(future.isFinished());
+    QCOMPARE(future.errorCode(), 42);
+    QCOMPARE(future.errorMessage(), QStringLiteral("failed"));
+    QVERIFY(!resumed);
+}
+
+void CoroutineTest::testSettled()
+{
+    KAsync::Job<int> job = []() -> KAsync::Task<int> {
+        const auto result = co_await KAsync::settled(KAsync::error<int>({42, "failed"}));
+        co_return result.errorCode();
+    }();
+
+    auto future = job.exec();
+    QVERIFY(future.isFinished());
+    QVERIFY(!future.hasError());
+    QCOMPARE(future.value(), 42);
+}
+
+void CoroutineTest::testCancel()
+{
+    bool innerCanceled = false;
+    bool resumed = false;
+    auto inner = KAsync::start<void>([&innerCanceled](KAsync::Future<void> &future) {
+        future.onCanceled([&innerCanceled]() {
+            innerCanceled = true;
+        });
+    });
+    KAsync::Job<void> job = [](KAsync::Job<void> inner, bool *resumed) -> KAsync::Task<void> {
+        co_await inner;
+        *resumed = true;
+    }(inner, &resumed);
+
+    auto future = job.exec();
+    QVERIFY(!future.isFinished());
+    future.cancel();
+    QVERIFY(future.isFinished());
+    QVERIFY(future.isCanceled());
+    QVERIFY(innerCanceled);
+    QVERIFY(!resumed);
+}
+
+void CoroutineTest::testExecuteOnce()
+{
+    KAsync::Job<int> job = sum(0);
+    QCOMPARE(job.exec().value(), 0);
+    QVERIFY(job.exec().hasError());
+}
+
+QTEST_MAIN(CoroutineTest)
+
+#include "coroutinetest.moc"
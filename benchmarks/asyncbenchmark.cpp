@@ -0,0 +1,390 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only OR LicenseRef-KDE-Accepted-GPL
+*/
+
+// Krazy mistakes job.exec() for QDialog::exec() and urges us to use QPointer
+//krazy:excludeall=crashy
+
+#include "../src/async.h"
+#include "../src/trace.h"
+
+#include <QObject>
+#include <QList>
+#include <QtTest/QTest>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+
+/*
+ * Counts the heap allocations of the whole process, so the benchmarks can
+ * report the allocations per step of a job chain.
+ */
+static std::atomic<quint64> sAllocations{0};
+// Bytes allocated by the current thread, for KAsync::setAllocationCounter()
+static thread_local quint64 tAllocatedBytes = 0;
+
+void *operator new(std::size_t size)
+{
+    ++sAllocations;
+    tAllocatedBytes += size;
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace {
+
+KAsync::Job<int> syncChain(int steps)
+{
+    auto job = KAsync::value(0);
+    for (int i = 0; i < steps; ++i) {
+        job = job.then([](int value) {
+            return value + 1;
+        });
+    }
+    return job;
+}
+
+KAsync::Job<int> asyncChain(int steps)
+{
+    auto job = KAsync::value(0);
+    for (int i = 0; i < steps; ++i) {
+        job = job.then<int, int>([](int value, KAsync::Future<int> &future) {
+            future.setResult(value + 1);
+        });
+    }
+    return job;
+}
+
+QList<int> values(int count)
+{
+    QList<int> list;
+    list.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        list << i;
+    }
+    return list;
+}
+
+} // namespace
+
+class AsyncBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void benchmarkChainBuild_data();
+    void benchmarkChainBuild();
+    void benchmarkSyncChainExec_data();
+    void benchmarkSyncChainExec();
+    void benchmarkAsyncChainExec_data();
+    void benchmarkAsyncChainExec();
+    void benchmarkExecLoop_data();
+    void benchmarkExecLoop();
+    void benchmarkExecBatch_data();
+    void benchmarkExecBatch();
+    void benchmarkAllocationsPerStep();
+    void benchmarkBytesPerStep();
+    void benchmarkForEach_data();
+    void benchmarkForEach();
+    void benchmarkSerialForEach_data();
+    void benchmarkSerialForEach();
+    void benchmarkMap_data();
+    void benchmarkMap();
+    void benchmarkDoWhile();
+    void benchmarkWaitForCompletion_data();
+    void benchmarkWaitForCompletion();
+};
+
+void AsyncBenchmark::benchmarkChainBuild_data()
+{
+    QTest::addColumn<int>("steps");
+
+    QTest::newRow("10") << 10;
+    QTest::newRow("1k") << 1000;
+}
+
+void AsyncBenchmark::benchmarkChainBuild()
+{
+    QFETCH(int, steps);
+
+    QBENCHMARK {
+        auto job = syncChain(steps);
+        Q_UNUSED(job);
+    }
+}
+
+void AsyncBenchmark::benchmarkSyncChainExec_data()
+{
+    QTest::addColumn<int>("steps");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("10") << 10;
+    QTest::newRow("100k") << 100000;
+}
+
+void AsyncBenchmark::benchmarkSyncChainExec()
+{
+    QFETCH(int, steps);
+    const auto job = syncChain(steps);
+
+    QBENCHMARK {
+        auto future = job.exec();
+        QCOMPARE(future.value(), steps);
+    }
+}
+
+void AsyncBenchmark::benchmarkAsyncChainExec_data()
+{
+    QTest::addColumn<int>("steps");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("10") << 10;
+    QTest::newRow("100k") << 100000;
+}
+
+void AsyncBenchmark::benchmarkAsyncChainExec()
+{
+    QFETCH(int, steps);
+    const auto job = asyncChain(steps);
+
+    QBENCHMARK {
+        auto future = job.exec();
+        QCOMPARE(future.value(), steps);
+    }
+}
+
+void AsyncBenchmark::benchmarkExecLoop_data()
+{
+    QTest::addColumn<int>("steps");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("10") << 10;
+}
+
+void AsyncBenchmark::benchmarkExecLoop()
+{
+    QFETCH(int, steps);
+    auto job = KAsync::start<int, int>([](int value) {
+        return value;
+    });
+    for (int i = 1; i < steps; ++i) {
+        job = job.then([](int value) {
+            return value + 1;
+        });
+    }
+    const auto inputs = values(1000);
+
+    QBENCHMARK {
+        for (int input : inputs) {
+            job.exec(input);
+        }
+    }
+}
+
+void AsyncBenchmark::benchmarkExecBatch_data()
+{
+    benchmarkExecLoop_data();
+}
+
+void AsyncBenchmark::benchmarkExecBatch()
+{
+    QFETCH(int, steps);
+    auto job = KAsync::start<int, int>([](int value) {
+        return value;
+    });
+    for (int i = 1; i < steps; ++i) {
+        job = job.then([](int value) {
+            return value + 1;
+        });
+    }
+    const auto inputs = values(1000);
+
+    QBENCHMARK {
+        auto future = job.execBatch(inputs);
+        QCOMPARE(future.value().size(), inputs.size());
+    }
+}
+
+void AsyncBenchmark::benchmarkAllocationsPerStep()
+{
+    const int steps = 1000;
+    const auto job = syncChain(steps);
+    // Leave out the one time setup of the context and the first step
+    const auto reference = syncChain(0);
+
+    const quint64 start = sAllocations;
+    job.exec();
+    const quint64 chain = sAllocations - start;
+    reference.exec();
+    const quint64 single = sAllocations - start - chain;
+
+    QTest::setBenchmarkResult(static_cast<qreal>(chain - single) / steps, QTest::Events);
+}
+
+void AsyncBenchmark::benchmarkBytesPerStep()
+{
+    const int steps = 1000;
+    const auto job = syncChain(steps);
+
+    // Only counts what the steps allocate while they run, unlike
+    // benchmarkAllocationsPerStep() which includes setting up the chain
+    qint64 bytes = 0;
+    int reported = 0;
+    KAsync::setAllocationCounter([]() {
+        return tAllocatedBytes;
+    });
+    KAsync::setStepStatsCallback([&](const KAsync::StepStats &stats) {
+        bytes += stats.allocatedBytes;
+        ++reported;
+    });
+    job.exec();
+    KAsync::setStepStatsCallback({});
+    KAsync::setAllocationCounter(nullptr);
+
+    QCOMPARE(reported, steps + 1);
+    QTest::setBenchmarkResult(static_cast<qreal>(bytes) / reported, QTest::BytesAllocated);
+}
+
+void AsyncBenchmark::benchmarkForEach_data()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("10") << 10;
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("100k") << 100000;
+}
+
+void AsyncBenchmark::benchmarkForEach()
+{
+    QFETCH(int, count);
+    const auto list = values(count);
+    int sum = 0;
+    const auto job = KAsync::forEach<QList<int>>(KAsync::start<void, int>([&sum](int value) {
+        sum += value;
+    }));
+
+    QBENCHMARK {
+        sum = 0;
+        job.exec(list);
+    }
+    QCOMPARE(sum, std::accumulate(list.cbegin(), list.cend(), 0));
+}
+
+void AsyncBenchmark::benchmarkSerialForEach_data()
+{
+    benchmarkForEach_data();
+}
+
+void AsyncBenchmark::benchmarkSerialForEach()
+{
+    QFETCH(int, count);
+    const auto list = values(count);
+    int sum = 0;
+    const auto job = KAsync::serialForEach<QList<int>>(KAsync::start<void, int>([&sum](int value) {
+        sum += value;
+    }));
+
+    QBENCHMARK {
+        sum = 0;
+        job.exec(list);
+    }
+    QCOMPARE(sum, std::accumulate(list.cbegin(), list.cend(), 0));
+}
+
+void AsyncBenchmark::benchmarkMap_data()
+{
+    benchmarkForEach_data();
+}
+
+void AsyncBenchmark::benchmarkMap()
+{
+    QFETCH(int, count);
+    const auto list = values(count);
+    const auto job = KAsync::map<QList<int>, int>(KAsync::start<int, int>([](int value) {
+        return value * 2;
+    }));
+
+    QBENCHMARK {
+        auto future = job.exec(list);
+        QCOMPARE(future.value().size(), count);
+    }
+}
+
+void AsyncBenchmark::benchmarkDoWhile()
+{
+    const int iterations = 100000;
+    int i = 0;
+    const auto job = KAsync::doWhile(KAsync::start<KAsync::ControlFlowFlag>([&i]() {
+        return ++i < iterations ? KAsync::Continue : KAsync::Break;
+    }));
+
+    QBENCHMARK {
+        i = 0;
+        auto future = job.exec();
+        QVERIFY(future.isFinished());
+    }
+    QCOMPARE(i, iterations);
+}
+
+void AsyncBenchmark::benchmarkWaitForCompletion_data()
+{
+    benchmarkForEach_data();
+}
+
+void AsyncBenchmark::benchmarkWaitForCompletion()
+{
+    QFETCH(int, count);
+    QList<KAsync::Future<void>> pending;
+    const auto pendingJob = KAsync::start<void>([&pending](KAsync::Future<void> &future) {
+        pending << future;
+    });
+
+    QBENCHMARK {
+        pending.clear();
+        QList<KAsync::Future<void>> futures;
+        futures.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            futures << pendingJob.exec();
+        }
+        auto future = KAsync::waitForCompletion(futures).exec();
+        for (auto &f : pending) {
+            f.setFinished();
+        }
+        QVERIFY(future.isFinished());
+    }
+}
+
+QTEST_MAIN(AsyncBenchmark)
+
+#include "asyncbenchmark.moc"
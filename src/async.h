@@ -14,6 +14,9 @@
 #include <functional>
 #include <type_traits>
 #include <cassert>
+#include <limits>
+#include <tuple>
+#include <variant>
 
 #include <QVariant>
 
@@ -48,11 +51,6 @@ class QObject;
  *        Job::exec() instantiates new Execution chain, which makes it possible for
  *        the Job to be executed multiple times (even in parallel).
  * * Future: Representation of the result that is being calculated
- *
- *
- * TODO: Possibility to abort a job through future (perhaps optional?)
- * TODO: Support for timeout, specified during exec call, after which the error
- *       handler gets called with a defined errorCode.
  */
 
 
@@ -110,6 +108,15 @@ auto start(F &&func) -> std::enable_if_t<std::is_base_of<JobBase, decltype(func(
     return Private::startImpl<Out, In...>(Private::ContinuationHolder<Out, In ...>(JobContinuation<Out, In...>(std::forward<F>(func))));
 }
 
+///Sync continuation run on a scheduler: (&scheduler, [] () -> T { ... })
+template<typename Out = void, typename ... In, typename F>
+auto start(Scheduler *scheduler, F &&func) -> decltype(start<Out, In ...>(std::forward<F>(func)))
+{
+    auto job = start<Out, In ...>(std::forward<F>(func));
+    job.on(scheduler);
+    return job;
+}
+
 ///Handle continuation: [] (KAsync::Future<T>, ...) { ... }
 template<typename Out = void, typename ... In>
 auto start(AsyncContinuation<Out, In ...> &&func) -> Job<Out, In ...>
@@ -152,6 +159,30 @@ KASYNC_EXPORT Job<void> doWhile(const JobContinuation<ControlFlowFlag> &body);
  */
 KASYNC_EXPORT Job<void> wait(int delay);
 
+/**
+ * @relates Job
+ *
+ * Delays between the attempts of Job::retry().
+ *
+ * The delay grows exponentially from @p initialDelay by @p multiplier with
+ * each attempt, up to @p maxDelay. A random part of up to @p jitter times the
+ * delay is subtracted from it, so that many clients that failed at the same
+ * time don't all retry at the same time.
+ */
+struct BackoffPolicy
+{
+    int initialDelay = 100; ///< Delay before the second attempt, in milliseconds
+    double multiplier = 2.0; ///< Factor by which the delay grows with each attempt
+    int maxDelay = 30000; ///< Upper bound of the delay, in milliseconds
+    double jitter = 0.5; ///< Randomized fraction of the delay, 0 for none, 1 for anything from 0 to the delay
+
+    /**
+     * Returns the delay in milliseconds after the failed attempt @p attempt,
+     * counting from 1.
+     */
+    int delay(int attempt) const;
+};
+
 /**
  * @relates Job
  *
@@ -194,6 +225,57 @@ Job<void, List> forEach(KAsync::Job<void, ValueType> job);
 template<typename List, typename ValueType = typename List::value_type>
  Job<void, List> forEach(JobContinuation<void, ValueType> &&);
 
+/**
+ * @relates Job
+ *
+ * Error handling policy of a bounded forEach loop.
+ */
+enum ErrorPolicy {
+    ContinueOnError, ///< Keep processing the remaining values after an error
+    StopOnError ///< Don't start any new values once an error has been seen
+};
+
+/**
+ * @relates Job
+ *
+ * Options of Job::execBatch().
+ */
+struct BatchOptions {
+    /// Maximum number of inputs processed at the same time
+    int maxConcurrency = std::numeric_limits<int>::max();
+    ErrorPolicy errorPolicy = ContinueOnError;
+};
+
+/**
+ * @relates Job
+ *
+ * Async foreach loop with a limited number of parallel executions.
+ *
+ * This will execute a job for every value in the list, but at most @p maxConcurrency
+ * jobs are running at the same time. The next value is only started once one of
+ * the running jobs has finished, so the number of pending executions does not
+ * grow with the size of the list.
+ *
+ * The errors are set on the wrapper job, up to errorLimit() of them in the order
+ * the jobs failed. With StopOnError no further values
+ * are started once an error has been seen, the jobs that are already running are
+ * still waited for.
+ */
+template<typename List, typename ValueType = typename List::value_type>
+Job<void, List> forEach(KAsync::Job<void, ValueType> job, int maxConcurrency, ErrorPolicy errorPolicy = ContinueOnError);
+
+/**
+ * @relates Job
+ *
+ * Async foreach loop with a limited number of parallel executions.
+ *
+ * Shorthand that takes a continuation.
+ *
+ * @see forEach(KAsync::Job<void, ValueType>, int, ErrorPolicy)
+ */
+template<typename List, typename ValueType = typename List::value_type>
+Job<void, List> forEach(JobContinuation<void, ValueType> &&, int maxConcurrency, ErrorPolicy errorPolicy = ContinueOnError);
+
 
 /**
  * @relates Job
@@ -202,6 +284,9 @@ template<typename List, typename ValueType = typename List::value_type>
  *
  * This will execute a job for every value in the list sequentially.
  * Errors while not stop processing of other jobs but set an error on the wrapper job.
+ *
+ * The job for a value is only started once the previous one has finished,
+ * so the memory used does not grow with the size of the list.
  */
 template<typename List, typename ValueType = typename List::value_type>
 Job<void, List> serialForEach(KAsync::Job<void, ValueType> job);
@@ -218,12 +303,192 @@ Job<void, List> serialForEach(KAsync::Job<void, ValueType> job);
 template<typename List, typename ValueType = typename List::value_type>
 Job<void, List> serialForEach(JobContinuation<void, ValueType> &&);
 
+/**
+ * @relates Job
+ *
+ * Async map.
+ *
+ * This will execute a job for every value in the list, like forEach(), and
+ * collect the results in the order of the values. Each result is written to
+ * its own slot of a buffer that is allocated up front, so the jobs may finish
+ * in any order. The Result type must be default-constructible.
+ *
+ * The errors are set on the wrapper job instead of the results, see
+ * forEach(KAsync::Job<void, ValueType>, int, ErrorPolicy).
+ */
+template<typename List, typename Result, typename ValueType = typename List::value_type>
+Job<QVector<Result>, List> map(KAsync::Job<Result, ValueType> job);
+
+/**
+ * @relates Job
+ *
+ * Async map with a limited number of parallel executions.
+ *
+ * At most @p maxConcurrency jobs are running at the same time, see
+ * forEach(KAsync::Job<void, ValueType>, int, ErrorPolicy).
+ */
+template<typename List, typename Result, typename ValueType = typename List::value_type>
+Job<QVector<Result>, List> map(KAsync::Job<Result, ValueType> job, int maxConcurrency, ErrorPolicy errorPolicy = ContinueOnError);
+
+/**
+ * @relates Job
+ *
+ * Async map.
+ *
+ * Shorthand that takes a continuation.
+ */
+template<typename List, typename Result, typename ValueType = typename List::value_type>
+Job<QVector<Result>, List> map(JobContinuation<Result, ValueType> &&);
+
+/**
+ * @relates Job
+ *
+ * Async map with a limited number of parallel executions.
+ *
+ * Shorthand that takes a continuation.
+ */
+template<typename List, typename Result, typename ValueType = typename List::value_type>
+Job<QVector<Result>, List> map(JobContinuation<Result, ValueType> &&, int maxConcurrency, ErrorPolicy errorPolicy = ContinueOnError);
+
+/**
+ * @relates Job
+ *
+ * Async reduce.
+ *
+ * This will execute a job for every value in the list, like forEach(), and
+ * fold each result into the accumulator, starting with @p init, as soon as the
+ * job has finished. Only the accumulator and the results of the running jobs
+ * are kept, not the results of all values.
+ *
+ * The results are combined in the order the jobs finish, which is not the order
+ * of the values unless at most one job runs at a time, so @p combiner should
+ * not depend on the order.
+ *
+ * The errors are set on the wrapper job instead of the accumulator, see
+ * forEach(KAsync::Job<void, ValueType>, int, ErrorPolicy).
+ *
+ * @code
+ * auto job = KAsync::reduce<QStringList, FileIndex, FileIndex>([](const QString &file) {
+ *         return indexFile(file);
+ *     },
+ *     FileIndex{}, [](FileIndex index, FileIndex fragment) {
+ *         index.merge(fragment);
+ *         return index;
+ *     });
+ * @endcode
+ */
+template<typename List, typename Result, typename Acc, typename ValueType = typename List::value_type>
+Job<Acc, List> reduce(KAsync::Job<Result, ValueType> job, Acc init, std::function<Acc(Acc, Result)> combiner,
+                      int maxConcurrency = std::numeric_limits<int>::max(), ErrorPolicy errorPolicy = ContinueOnError);
+
+/**
+ * @relates Job
+ *
+ * Async reduce.
+ *
+ * Shorthand that takes a continuation.
+ */
+template<typename List, typename Result, typename Acc, typename ValueType = typename List::value_type>
+Job<Acc, List> reduce(JobContinuation<Result, ValueType> &&, Acc init, std::function<Acc(Acc, Result)> combiner,
+                      int maxConcurrency = std::numeric_limits<int>::max(), ErrorPolicy errorPolicy = ContinueOnError);
+
+/**
+ * @relates Job
+ *
+ * Parallel foreach loop for CPU bound work.
+ *
+ * Calls @p func for every value in the list on @p scheduler. Instead of
+ * scheduling each value on its own, the list is split in halves recursively:
+ * a task scheduled for a range of values schedules one half of it and goes on
+ * with the other, until at most @p grainSize values are left, which it
+ * processes. With a WorkStealingScheduler idle workers take over the halves
+ * that are still waiting, so the load is balanced even if some values take far
+ * longer than others.
+ *
+ * The list must provide random access. The wrapper job finishes in the thread
+ * that executed it once all values have been processed. Canceling it skips
+ * the values that haven't been started yet.
+ */
+template<typename List>
+Job<void, List> parallelForEach(Scheduler *scheduler, std::function<void(const typename List::value_type &)> func,
+                                int grainSize = 1);
+
+/**
+ * @relates Job
+ *
+ * Parallel map for CPU bound work.
+ *
+ * Like parallelForEach(), but returns the results of @p func in the order of
+ * the values.
+ */
+template<typename List, typename Result>
+Job<QVector<Result>, List> parallelMap(Scheduler *scheduler, std::function<Result(const typename List::value_type &)> func,
+                                       int grainSize = 1);
+
 /**
  * @brief Wait until all given futures are completed.
+ *
+ * Errors of the futures are ignored, use whenAll() to get them reported.
  */
 template<template<typename> class Container>
 Job<void> waitForCompletion(Container<KAsync::Future<void>> &futures);
 
+/**
+ * @relates Job
+ *
+ * Waits until all given futures are completed and returns their values in
+ * the order of the container.
+ *
+ * If any of the futures failed their errors, in the order of the container and
+ * up to errorLimit() of them, are set instead. Canceling the job cancels the pending futures.
+ */
+template<typename T, template<typename> class Container, std::enable_if_t<!std::is_void<T>::value, int> = 0>
+Job<QVector<T>> whenAll(const Container<KAsync::Future<T>> &futures);
+
+/**
+ * @relates Job
+ *
+ * Waits until all given futures are completed, setting their errors if any
+ * of them failed.
+ */
+template<template<typename> class Container>
+Job<void> whenAll(const Container<KAsync::Future<void>> &futures);
+
+/**
+ * @relates Job
+ *
+ * Waits until all given futures, which may have different types, are
+ * completed and returns their values as a tuple.
+ *
+ * @code
+ * KAsync::whenAll(contacts.exec(), events.exec())
+ *     .then([](const std::tuple<Contacts, Events> &result) {
+ *         ...
+ *     });
+ * @endcode
+ */
+template<typename ... T>
+Job<std::tuple<T ...>> whenAll(const KAsync::Future<T> & ... futures);
+
+/**
+ * @relates Job
+ *
+ * Waits until the first of the given futures is completed and takes over its
+ * value or errors. The other futures are canceled.
+ */
+template<typename T, template<typename> class Container>
+Job<T> whenAny(const Container<KAsync::Future<T>> &futures);
+
+/**
+ * @relates Job
+ *
+ * Waits until the first of the given futures, which may have different types,
+ * is completed and takes over its value or errors. The index of the variant
+ * is the position of that future. The other futures are canceled.
+ */
+template<typename ... T>
+Job<std::variant<T ...>> whenAny(const KAsync::Future<T> & ... futures);
+
 /**
  * @relates Job
  *
@@ -330,6 +595,9 @@ class [[nodiscard]] Job : public JobBase
     template<typename List, typename ValueType>
     friend  Job<void, List> forEach(KAsync::Job<void, ValueType> job);
 
+    template<typename List, typename ValueType>
+    friend  Job<void, List> forEach(KAsync::Job<void, ValueType> job, int maxConcurrency, ErrorPolicy errorPolicy);
+
     template<typename List, typename ValueType>
     friend Job<void, List> serialForEach(KAsync::Job<void, ValueType> job);
 
@@ -467,6 +735,19 @@ public:
         return then<void, In ...>(forEach<Out, ValueType>(std::forward<JobContinuation<void, ValueType>>(func)));
     }
 
+    /**
+     * Shorthand for a bounded forEach loop that automatically uses the return type
+     * of this job to deduce the type expected.
+     *
+     * @see forEach(KAsync::Job<void, ValueType>, int, ErrorPolicy)
+     */
+    template<typename OutOther = void, typename ListType = Out, typename ValueType = typename ListType::value_type, std::enable_if_t<!std::is_void<ListType>::value, int> = 0>
+    Job<void, In ...> each(JobContinuation<void, ValueType> &&func, int maxConcurrency, ErrorPolicy errorPolicy = ContinueOnError) const
+    {
+        eachInvariants<OutOther>();
+        return then<void, In ...>(forEach<Out, ValueType>(std::forward<JobContinuation<void, ValueType>>(func), maxConcurrency, errorPolicy));
+    }
+
     /**
      * Shorthand for a serialForEach loop that automatically uses the return type
      * of this job to deduce the type expected.
@@ -478,6 +759,20 @@ public:
         return then<void, In ...>(serialForEach<Out, ValueType>(std::forward<JobContinuation<void, ValueType>>(func)));
     }
 
+    /**
+     * Shorthand for a map loop that automatically uses the return type of this
+     * job to deduce the type expected.
+     *
+     * @see map(KAsync::Job<Result, ValueType>, int, ErrorPolicy)
+     */
+    template<typename Result, typename ListType = Out, typename ValueType = typename ListType::value_type, std::enable_if_t<!std::is_void<ListType>::value, int> = 0>
+    Job<QVector<Result>, In ...> map(JobContinuation<Result, ValueType> &&func, int maxConcurrency = std::numeric_limits<int>::max(),
+                                     ErrorPolicy errorPolicy = ContinueOnError) const
+    {
+        eachInvariants<void>();
+        return then<QVector<Result>, In ...>(KAsync::map<Out, Result, ValueType>(std::forward<JobContinuation<Result, ValueType>>(func), maxConcurrency, errorPolicy));
+    }
+
     /**
      * Enable implicit conversion to Job<void>.
      *
@@ -518,6 +813,101 @@ public:
         return *this;
     }
 
+    /**
+     * Runs the synchronous continuation of this job on @p scheduler instead
+     * of the thread that finished the previous job.
+     *
+     * The result is delivered back to the thread that ran the previous job,
+     * so the following jobs are not affected. If that thread runs no event
+     * loop, like the workers of a QThreadPool, the following jobs continue in
+     * the thread of the scheduler instead.
+     *
+     * @see Scheduler
+     */
+    Job<Out, In ...> &on(Scheduler *scheduler)
+    {
+        assert(mExecutor);
+        mExecutor->setScheduler(scheduler);
+        return *this;
+    }
+
+    /**
+     * Fails this job with a TimeoutError if it has not finished @p msecs
+     * milliseconds after it started.
+     *
+     * The job is canceled, so its onCanceled() handlers are invoked, and then
+     * fails with the TimeoutError. The following jobs see it like any other
+     * error, an onError() handler can recover from it. To limit a whole chain,
+     * wrap it in a job continuation and set the timeout on that.
+     *
+     * The deadline is tracked by the event loop of the thread the job starts
+     * in, so timeouts need a running event loop there. In threads without one,
+     * like the workers of a QThreadPool, the timeout has no effect.
+     */
+    Job<Out, In ...> &timeout(int msecs)
+    {
+        assert(mExecutor);
+        mExecutor->setTimeout(msecs);
+        return *this;
+    }
+
+    /**
+     * Names this job, so the statistics of its executions are collected
+     * under @p name. They can be read with jobMetrics().
+     *
+     * Like timeout(), this applies to the last job of a chain only. Name a
+     * job continuation wrapping the chain to collect the statistics of the
+     * whole chain. Several jobs may share a name, their statistics are added.
+     *
+     * @see JobMetrics
+     */
+    Job<Out, In ...> &name(const QString &name)
+    {
+        assert(mExecutor);
+        mExecutor->setName(name);
+        return *this;
+    }
+
+    /**
+     * Sets the share of this job in the progress of a chain. By default all
+     * jobs of a chain have a weight of 1, so a chain of four jobs is half done
+     * once two of them have finished.
+     *
+     * Progress reported by this job through Future::setProgress() is passed on
+     * to the Future returned by Job::exec(), scaled to its share.
+     */
+    Job<Out, In ...> &progressWeight(qreal weight)
+    {
+        assert(mExecutor);
+        mExecutor->setProgressWeight(weight);
+        return *this;
+    }
+
+    /**
+     * Returns a job that executes this job again when it fails, up to
+     * @p maxAttempts times in total.
+     *
+     * Before each new attempt the job waits as long as given by @p backoff.
+     * If @p predicate is set only the errors it returns true for are retried,
+     * the others are reported right away. Once all attempts have failed the
+     * errors of the last one are reported.
+     *
+     * Each attempt executes the same job, with a copy of the input. Canceling
+     * the returned job cancels the running attempt or the pending delay.
+     *
+     * @code
+     * auto job = fetchFeed(url).retry(5, {}, [](const KAsync::Error &error) {
+     *     return error.errorCode == NetworkError;
+     * });
+     * @endcode
+     *
+     * The delays are tracked by the event loop of the thread the failed
+     * attempt finished in. In threads that run no event loop, like the
+     * workers of a QThreadPool, the next attempt starts right away.
+     */
+    Job<Out, In ...> retry(int maxAttempts, const BackoffPolicy &backoff = BackoffPolicy(),
+                           const std::function<bool(const KAsync::Error &)> &predicate = {}) const;
+
     /**
      * @brief Starts execution of the job chain.
      *
@@ -526,6 +916,9 @@ public:
      * invocation will start a new processing and provide a new Future to
      * watch its status.
      *
+     * Executing a job does not modify it, so a job can be built once and then
+     * be executed concurrently from multiple threads.
+     *
      * @param in Argument to be passed to the very first task
      * @return Future&lt;Out&gt; object which will contain result of the last
      * task once if finishes executing. See Future documentation for more details.
@@ -533,7 +926,7 @@ public:
      * @see exec(), Future
      */
     template<typename FirstIn>
-    KAsync::Future<Out> exec(FirstIn in);
+    KAsync::Future<Out> exec(FirstIn in) const;
 
     /**
      * @brief Starts execution of the job chain.
@@ -548,7 +941,29 @@ public:
      *
      * @see exec(FirstIn in), Future
      */
-    KAsync::Future<Out> exec();
+    KAsync::Future<Out> exec() const;
+
+    /**
+     * @brief Executes the job chain once for every input of a list.
+     *
+     * Like calling exec() for each value of @p inputs, but the executors of
+     * the chain are only collected once for all inputs, which saves most of
+     * the setup of an execution when running a short job over many small
+     * inputs. At most @c options.maxConcurrency inputs are processed at the
+     * same time, the next one is started as soon as a running one finishes.
+     *
+     * The returned Future finishes once all inputs have been processed, with
+     * the results in the order of the inputs, or with the errors of the
+     * failed inputs, see forEach(KAsync::Job<void, ValueType>, int, ErrorPolicy).
+     * Canceling it cancels the running executions.
+     *
+     * @code
+     * auto future = parseMessage.execBatch(messages, {16});
+     * @endcode
+     */
+    template<typename List>
+    KAsync::Future<std::conditional_t<std::is_void<Out>::value, void, QVector<Out>>>
+    execBatch(List inputs, const BatchOptions &options = BatchOptions()) const;
 
     explicit Job(JobContinuation<Out, In ...> &&func);
     explicit Job(AsyncContinuation<Out, In ...> &&func);
@@ -0,0 +1,380 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_COROUTINE_H
+#define KASYNC_COROUTINE_H
+
+#include "async.h"
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "KAsync/Coroutine requires a compiler with C++20 coroutine support"
+#endif
+
+#include <QMutex>
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/**
+ * @defgroup Coroutine C++20 coroutines
+ *
+ * Jobs and futures can be awaited from coroutines returning a KAsync::Task,
+ * so loops and branches can be written as plain code instead of chains of
+ * jobs. This header requires C++20, the rest of KAsync does not.
+ *
+ * @code
+ * KAsync::Task<int> countUnread(Folder folder)
+ * {
+ *     int unread = 0;
+ *     for (const auto &id : co_await fetchIds(folder)) { // a KAsync::Job<QVector<Id>>
+ *         const Message message = co_await fetchMessage(id);
+ *         if (!message.isRead()) {
+ *             ++unread;
+ *         }
+ *     }
+ *     co_return unread;
+ * }
+ *
+ * KAsync::Job<int> job = countUnread(inbox);
+ * @endcode
+ *
+ * Awaiting a job or future that finishes with an error ends the coroutine,
+ * and the Task fails with all of its errors, just like the following jobs of a chain
+ * are skipped. Use KAsync::settled() to handle the error in the coroutine
+ * instead. Canceling the Task cancels the job or future it is awaiting.
+ *
+ * The coroutine is resumed directly from the thread finishing the awaited
+ * future, without going through the event loop.
+ */
+
+namespace KAsync {
+
+template<typename T>
+class Task;
+
+//@cond PRIVATE
+namespace Private {
+
+template<typename T>
+class TaskPromise;
+
+/*
+ * Cancels the future a Task is suspended on. Shared by the promise and the
+ * onCanceled() handler of the job, so that a cancel from another thread never
+ * touches the promise, which the coroutine may destroy meanwhile.
+ */
+class TaskCancelHook
+{
+public:
+    void set(std::function<void()> &&cancel)
+    {
+        QMutexLocker locker(&mMutex);
+        mCancel = std::move(cancel);
+    }
+
+    void cancel()
+    {
+        std::function<void()> cancel;
+        {
+            QMutexLocker locker(&mMutex);
+            cancel = mCancel;
+        }
+        if (cancel) {
+            cancel();
+        }
+    }
+
+private:
+    QMutex mMutex;
+    std::function<void()> mCancel;
+};
+
+class TaskPromiseBase
+{
+public:
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    // The frame destroys itself once the coroutine has finished
+    std::suspend_never final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        // Like an exception thrown from a continuation
+        std::terminate();
+    }
+
+    // Cancels the future the coroutine is suspended on, if any
+    const std::shared_ptr<TaskCancelHook> cancelHook = std::make_shared<TaskCancelHook>();
+};
+
+template<typename T>
+class TaskPromiseStorage : public TaskPromiseBase
+{
+public:
+    Task<T> get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(static_cast<TaskPromise<T> &>(*this)));
+    }
+
+    // The future of the job step running the coroutine, set when it is started
+    std::optional<KAsync::Future<T>> future;
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseStorage<T>
+{
+public:
+    void return_value(T value)
+    {
+        this->future->setResult(std::move(value));
+    }
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseStorage<void>
+{
+public:
+    void return_void()
+    {
+        this->future->setFinished();
+    }
+};
+
+/*
+ * Suspends the coroutine until the future has finished. Unless the awaiter
+ * is settled, an error fails the Task and ends the coroutine.
+ */
+template<typename T, bool Settled>
+class FutureAwaiter
+{
+public:
+    FutureAwaiter(const KAsync::Future<T> &future, bool owned)
+        : mFuture(future)
+        , mOwned(owned)
+    {}
+
+    bool await_ready() const
+    {
+        return Settled ? mFuture.isFinished() : (mFuture.isFinished() && !mFuture.hasError());
+    }
+
+    template<typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle)
+    {
+        static_assert(Settled || std::is_base_of<TaskPromiseBase, Promise>::value,
+                      "Only coroutines returning a KAsync::Task can await a job or future without KAsync::settled()");
+        if constexpr (std::is_base_of<TaskPromiseBase, Promise>::value) {
+            handle.promise().cancelHook->set([future = mFuture]() mutable {
+                future.cancel();
+            });
+        }
+        mFuture.onFinished([this, handle]() {
+            if constexpr (std::is_base_of<TaskPromiseBase, Promise>::value) {
+                handle.promise().cancelHook->set(nullptr);
+                if (!Settled && mFuture.hasError()) {
+                    handle.promise().future->setErrors(mFuture.errors());
+                    handle.destroy();
+                    return;
+                }
+            }
+            handle.resume();
+        });
+    }
+
+    auto await_resume()
+    {
+        if constexpr (Settled) {
+            return mFuture;
+        } else if constexpr (std::is_void<T>::value) {
+            return;
+        } else if constexpr (std::is_copy_constructible<T>::value) {
+            // The future of an awaited job is not seen by anyone else
+            return mOwned ? mFuture.takeValue() : mFuture.value();
+        } else {
+            return mFuture.takeValue();
+        }
+    }
+
+private:
+    KAsync::Future<T> mFuture;
+    const bool mOwned;
+};
+
+template<typename T>
+class TaskFrame
+{
+public:
+    explicit TaskFrame(std::coroutine_handle<TaskPromise<T>> handle)
+        : handle(handle)
+    {}
+
+    ~TaskFrame()
+    {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<TaskPromise<T>> handle;
+};
+
+} // namespace Private
+//@endcond
+
+/**
+ * @ingroup Coroutine
+ *
+ * @brief The return type of coroutines that can be used as a Job.
+ *
+ * Calling the coroutine doesn't run it yet. The Task is converted to a
+ * Job&lt;T&gt;, and the coroutine runs when that job is executed. The coroutine
+ * finishes the job by returning a value with co_return.
+ *
+ * Since the coroutine keeps its state in its frame, a Task can only be
+ * executed once. To execute it repeatedly, create the Task in a job
+ * continuation:
+ *
+ * @code
+ * auto job = KAsync::start<int>([folder]() -> KAsync::Job<int> {
+ *     return countUnread(folder);
+ * });
+ * @endcode
+ */
+template<typename T>
+class [[nodiscard]] Task
+{
+public:
+    using promise_type = Private::TaskPromise<T>;
+
+    Task(Task &&other) noexcept
+        : mHandle(std::exchange(other.mHandle, {}))
+    {}
+
+    Task &operator=(Task &&other) noexcept
+    {
+        std::swap(mHandle, other.mHandle);
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (mHandle) {
+            mHandle.destroy();
+        }
+    }
+
+    /**
+     * Returns a job running the coroutine. Executing the job a second time
+     * fails with an error.
+     */
+    operator Job<T>()
+    {
+        auto frame = std::make_shared<Private::TaskFrame<T>>(std::exchange(mHandle, {}));
+        return KAsync::start<T>(AsyncContinuation<T>([frame](KAsync::Future<T> &future) {
+            const auto handle = std::exchange(frame->handle, {});
+            if (!handle) {
+                future.setError(1, QStringLiteral("A KAsync::Task can only be executed once"));
+                return;
+            }
+            auto &promise = handle.promise();
+            promise.future.emplace(future);
+            // The coroutine may end, and destroy the promise, while this runs
+            future.onCanceled([cancelHook = promise.cancelHook]() {
+                cancelHook->cancel();
+            });
+            handle.resume();
+        }));
+    }
+
+private:
+    friend class Private::TaskPromiseStorage<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : mHandle(handle)
+    {}
+
+    std::coroutine_handle<promise_type> mHandle;
+};
+
+/**
+ * @ingroup Coroutine
+ *
+ * Awaits @p future and returns the finished future, whether it failed or not,
+ * instead of its value. Unlike awaiting the future itself, this can be used
+ * from any coroutine, not only from those returning a Task.
+ *
+ * @code
+ * const auto result = co_await KAsync::settled(job.exec());
+ * if (result.hasError()) {
+ *     ...
+ * }
+ * @endcode
+ */
+template<typename T>
+Private::FutureAwaiter<T, true> settled(const KAsync::Future<T> &future)
+{
+    return {future, false};
+}
+
+/**
+ * @ingroup Coroutine
+ *
+ * Executes @p job and returns the finished future, see settled(const KAsync::Future<T> &).
+ */
+template<typename T>
+Private::FutureAwaiter<T, true> settled(const KAsync::Job<T> &job)
+{
+    return {job.exec(), true};
+}
+
+/**
+ * @ingroup Coroutine
+ *
+ * Makes a Future awaitable in a Task, which resumes with its value.
+ */
+template<typename T>
+Private::FutureAwaiter<T, false> operator co_await(const KAsync::Future<T> &future)
+{
+    return {future, false};
+}
+
+/**
+ * @ingroup Coroutine
+ *
+ * Makes a Job awaitable in a Task. The job is executed and the Task resumes
+ * with its result.
+ */
+template<typename T>
+Private::FutureAwaiter<T, false> operator co_await(const KAsync::Job<T> &job)
+{
+    return {job.exec(), true};
+}
+
+/**
+ * @ingroup Coroutine
+ *
+ * Makes a Task awaitable in another Task.
+ */
+template<typename T>
+Private::FutureAwaiter<T, false> operator co_await(Task<T> &&task)
+{
+    const Job<T> job = std::move(task);
+    return {job.exec(), true};
+}
+
+} // namespace KAsync
+
+#endif // KASYNC_COROUTINE_H
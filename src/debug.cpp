@@ -40,10 +40,10 @@ QString demangleName(const char *name)
 
 using namespace KAsync;
 
-int Tracer::lastId = 0;
+QAtomicInt Tracer::lastId = 0;
 
 Tracer::Tracer(Private::Execution *execution)
-    : mId(lastId++)
+    : mId(lastId.fetchAndAddRelaxed(1))
     , mExecution(execution)
 {
     msg(KAsync::Tracer::Start);
@@ -53,7 +53,7 @@ Tracer::~Tracer()
 {
     msg(KAsync::Tracer::End);
     // FIXME: Does this work on parallel executions?
-    --lastId;
+    lastId.fetchAndAddRelaxed(-1);
     --mId;
 }
 
@@ -62,5 +62,5 @@ void Tracer::msg(Tracer::MsgType msgType)
     qCDebug(Trace).nospace() << (QString().fill(QLatin1Char(' '), mId * 2) % 
                                  (msgType == KAsync::Tracer::Start ? QStringLiteral(" START ") : QStringLiteral(" END   ")) %
                                  QString::number(mId) % QStringLiteral(" ") %
-                                 mExecution->executor->mExecutorName);
+                                 demangleName(mExecution->executor->mExecutorName));
 }
@@ -11,13 +11,10 @@
 
 #include "kasync_export.h"
 
+#include <QAtomicInt>
 #include <QLoggingCategory>
 #include <QStringBuilder>
 
-#ifndef QT_NO_DEBUG
-#include <typeinfo>
-#endif
-
 namespace KAsync
 {
 
@@ -47,27 +44,9 @@ private:
     int mId;
     Private::Execution *mExecution;
 
-    static int lastId;
+    static QAtomicInt lastId;
 };
 
 }
 
-#ifndef QT_NO_DEBUG
-    template<typename T>
-    QString storeExecutorNameExpanded() {
-        return KAsync::demangleName(typeid(T).name());
-    }
-
-    template<typename T, typename ... Tail>
-    auto storeExecutorNameExpanded() -> std::enable_if_t<sizeof ... (Tail) != 0, QString>
-    {
-        return storeExecutorNameExpanded<T>() % QStringLiteral(", ") % storeExecutorNameExpanded<Tail ...>();
-    }
-
-    #define STORE_EXECUTOR_NAME(name, ...) \
-        ExecutorBase::mExecutorName = QStringLiteral(name "<") % storeExecutorNameExpanded<__VA_ARGS__>() % QStringLiteral(">")
-#else
-    #define STORE_EXECUTOR_NAME(...)
-#endif
-
 #endif // KASYNC_DEBUG_H
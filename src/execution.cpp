@@ -0,0 +1,114 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "execution_p.h"
+#include "async.h"
+
+#include <QVarLengthArray>
+
+#include <vector>
+
+using namespace KAsync;
+using namespace KAsync::Private;
+
+namespace {
+
+// Dropping the last reference to the end of a long chain would destroy the
+// whole chain recursively and overflow the stack. Instead, releases that
+// happen while another release is in progress on the same thread are deferred
+// and processed in a loop by the outermost one.
+template<typename T>
+void releaseIteratively(QSharedPointer<T> &ptr)
+{
+    static thread_local bool releasing = false;
+    static thread_local std::vector<QSharedPointer<T>> pending;
+
+    if (!ptr) {
+        return;
+    }
+    if (releasing) {
+        pending.push_back(std::move(ptr));
+        return;
+    }
+
+    releasing = true;
+    ptr.reset();
+    while (!pending.empty()) {
+        auto next = std::move(pending.back());
+        pending.pop_back();
+        next.reset();
+    }
+    releasing = false;
+}
+
+} // namespace
+
+Execution::~Execution()
+{
+    if (resultBase) {
+        resultBase->releaseExecution();
+        delete resultBase;
+    }
+    releaseIteratively(prevExecution);
+}
+
+void Execution::destroyResult()
+{
+    if (resultBase) {
+        resultBase->releaseExecution();
+        resultBase->~FutureBase();
+        resultBase = nullptr;
+    }
+}
+
+ExecutorBase::~ExecutorBase()
+{
+    releaseIteratively(mPrev);
+}
+
+ExecutionPtr ExecutorBase::exec(const ExecutorBasePtr &self, QSharedPointer<ExecutionContext> context)
+{
+    return ExecutionChain(self).exec(context);
+}
+
+ExecutionChain::ExecutionChain(const ExecutorBasePtr &last)
+{
+    // Collect the chain first, so that all guards are known before the first
+    // executor runs
+    for (auto executor = &last; *executor; executor = &(*executor)->mPrev) {
+        mExecutors.append(executor);
+        mProgressWeight += (*executor)->progressWeight();
+        const auto &extras = (*executor)->mExtras;
+        if (extras && !extras->guards.isEmpty()) {
+            mGuards += extras->guards;
+        }
+    }
+}
+
+ExecutionPtr ExecutionChain::exec(const QSharedPointer<ExecutionContext> &context) const
+{
+    context->guards = mGuards;
+    context->progressWeight = mProgressWeight;
+
+    // Set up all executions before starting the first one, so that the steps
+    // finishing synchronously already report their progress to the last one
+    QVarLengthArray<ExecutionPtr, 16> executions;
+    executions.reserve(mExecutors.size());
+    ExecutionPtr execution = context->input;
+    qreal progressOffset = 0;
+    for (int i = mExecutors.size() - 1; i >= 0; --i) {
+        execution = (*mExecutors[i])->setupExecution(*mExecutors[i], execution, context);
+        execution->progressOffset = progressOffset;
+        progressOffset += (*mExecutors[i])->progressWeight();
+        executions.append(execution);
+    }
+    context->last = execution;
+
+    for (const auto &e : executions) {
+        e->executor->startExecution(e);
+    }
+    return execution;
+}
@@ -12,12 +12,15 @@
 #include "kasync_export.h"
 
 #include "debug.h"
+#include "trace.h"
+#include "metrics.h"
 
 #include <QSharedPointer>
 #include <QPointer>
 #include <QVector>
 #include <QObject>
 
+#include <atomic>
 #include <memory>
 
 namespace KAsync {
@@ -47,23 +50,49 @@ enum ExecutionFlag {
     GoodCase
 };
 
+/*
+ * The state of the diagnostic hooks of an execution, kept out of Execution so
+ * that executions don't pay for it while no hook is enabled.
+ */
+struct Instrumentation {
+    // Only set while the step is traced, see trace.h
+    quint64 traceId = 0;
+    quint64 traceParentId = 0;
+    // Only set while the step of a named job runs, see metrics.h
+    MetricsCounters *metrics = nullptr;
+    qint64 metricsStart = 0;
+    // Only set while step statistics are collected, see trace.h
+    qint64 statsReadyTime = 0;
+    qint64 statsStart = 0;
+    qint64 statsAllocationStart = 0;
+    // Set by the running thread, read by the one finishing the step
+    std::atomic<qint64> statsAllocated{-1};
+    std::atomic<Qt::HANDLE> statsThread{nullptr};
+    // Whether the continuation is still running in statsThread
+    std::atomic<bool> statsRunning{false};
+};
+
 struct KASYNC_EXPORT Execution {
     explicit Execution(const ExecutorBasePtr &executor)
         : executor(executor)
     {}
 
-    virtual ~Execution()
-    {
-        if (resultBase) {
-            resultBase->releaseExecution();
-            delete resultBase;
-        }
-        prevExecution.reset();
-    }
+    virtual ~Execution();
 
     void setFinished()
     {
         tracer.reset();
+        if (instrumentation) {
+            if (instrumentation->traceId) {
+                traceEnd(this);
+            }
+            if (instrumentation->metrics) {
+                metricsEnd(this);
+            }
+            if (instrumentation->statsStart) {
+                statsEnd(this);
+            }
+        }
     }
 
     template<typename T>
@@ -77,10 +106,42 @@ struct KASYNC_EXPORT Execution {
         resultBase = nullptr;
     }
 
+    // Destroys a result that was constructed in place, without freeing it
+    void destroyResult();
+
     ExecutorBasePtr executor;
     ExecutionPtr prevExecution;
+    QSharedPointer<ExecutionContext> context;
     std::unique_ptr<Tracer> tracer;
     FutureBase *resultBase = nullptr;
+    // The progress weights of the executions before this one in the chain
+    qreal progressOffset = 0;
+    // Only allocated while tracing, metrics or step statistics are enabled
+    std::unique_ptr<Instrumentation> instrumentation;
+
+    Instrumentation &instrument()
+    {
+        if (!instrumentation) {
+            instrumentation = std::make_unique<Instrumentation>();
+        }
+        return *instrumentation;
+    }
+};
+
+/*
+ * An execution along with storage for its result Future, so that both are
+ * allocated in one block. The Future is constructed by ExecutorBase::createExecution().
+ */
+template<typename T>
+struct TypedExecution : Execution {
+    using Execution::Execution;
+
+    ~TypedExecution() override
+    {
+        destroyResult();
+    }
+
+    alignas(KAsync::Future<T>) unsigned char futureStorage[sizeof(KAsync::Future<T>)];
 };
 
 class ExecutionContext {
@@ -88,6 +149,15 @@ public:
     using Ptr = QSharedPointer<ExecutionContext>;
 
     QVector<QPointer<const QObject>> guards;
+    // Finished execution holding the argument passed to Job::exec(FirstIn),
+    // it acts as the previous execution of the first executor in the chain.
+    ExecutionPtr input;
+    // The execution whose Future is returned by Job::exec(), and the sum of
+    // the progress weights of all executions in the chain
+    QWeakPointer<Execution> last;
+    qreal progressWeight = 0;
+    std::atomic<bool> canceled{false};
+
     bool guardIsBroken() const
     {
         for (const auto &g : guards) {
@@ -11,7 +11,14 @@
 
 #include "execution_p.h"
 #include "continuations_p.h"
+#include "scheduler.h"
 #include "debug.h"
+#include "trace.h"
+
+#include <QVarLengthArray>
+
+#include <memory>
+#include <typeinfo>
 
 namespace KAsync {
 
@@ -34,7 +41,7 @@ namespace Private {
 class ExecutorBase;
 using ExecutorBasePtr = QSharedPointer<ExecutorBase>;
 
-class ExecutorBase
+class KASYNC_EXPORT ExecutorBase
 {
     template<typename Out, typename ... In>
     friend class Executor;
@@ -43,49 +50,145 @@ class ExecutorBase
     friend class KAsync::Job;
 
     friend struct Execution;
+    friend class ExecutionChain;
     friend class KAsync::Tracer;
 
 public:
-    virtual ~ExecutorBase() = default;
+    virtual ~ExecutorBase();
+
+    const char *executorName() const
+    {
+        return mExecutorName;
+    }
+
+    qreal progressWeight() const
+    {
+        return mExtras ? mExtras->progressWeight : 1.0;
+    }
 
-    virtual ExecutionPtr exec(const ExecutorBasePtr &self, QSharedPointer<Private::ExecutionContext> context) = 0;
+    // Sets up the executions of the whole chain ending with this executor
+    ExecutionPtr exec(const ExecutorBasePtr &self, QSharedPointer<Private::ExecutionContext> context);
 
 protected:
-    ExecutorBase(const ExecutorBasePtr &parent)
-        : mPrev(parent)
+    // Sets up the execution of this executor alone, following prevExecution
+    virtual ExecutionPtr setupExecution(const ExecutorBasePtr &self, const ExecutionPtr &prevExecution,
+                                        const QSharedPointer<Private::ExecutionContext> &context) = 0;
+
+    // Runs @p execution once its previous execution has finished, or right away
+    virtual void startExecution(const ExecutionPtr &execution) = 0;
+
+    ExecutorBase(const ExecutorBasePtr &parent, const char *name)
+        : mExecutorName(name)
+        , mPrev(parent)
     {}
 
+    // Creates an execution of @p executor together with its result future
     template<typename T>
-    KAsync::Future<T>* createFuture(const ExecutionPtr &execution) const
+    static ExecutionPtr createExecution(const ExecutorBasePtr &executor)
     {
-        return new KAsync::Future<T>(execution);
+        auto execution = QSharedPointer<TypedExecution<T>>::create(executor);
+        execution->resultBase = new (execution->futureStorage) KAsync::Future<T>(execution);
+        return execution;
     }
 
     void prepend(const ExecutorBasePtr &e)
     {
-        if (mPrev) {
-            mPrev->prepend(e);
-        } else {
-            mPrev = e;
+        ExecutorBase *first = this;
+        while (first->mPrev) {
+            first = first->mPrev.data();
         }
+        first->mPrev = e;
     }
 
     void addToContext(const QVariant &entry)
     {
-        mContext.push_back(entry);
+        extras().context.push_back(entry);
     }
 
     void guard(const QObject *o)
     {
-        mGuards.push_back(QPointer<const QObject>{o});
+        extras().guards.push_back(QPointer<const QObject>{o});
     }
 
-    QString mExecutorName;
-    QVector<QVariant> mContext;
-    QVector<QPointer<const QObject>> mGuards;
+    void setScheduler(Scheduler *scheduler)
+    {
+        mScheduler = scheduler;
+    }
+
+    void setTimeout(int msecs)
+    {
+        mTimeout = msecs;
+    }
+
+    void setName(const QString &name)
+    {
+        mMetrics = metricsCounters(name);
+    }
+
+    void setProgressWeight(qreal weight)
+    {
+        extras().progressWeight = weight;
+    }
+
+    // State that few executors use, allocated by the first addToContext(), guard()
+    // or setProgressWeight()
+    struct Extras {
+        QVector<QVariant> context;
+        QVector<QPointer<const QObject>> guards;
+        qreal progressWeight = 1.0;
+    };
+
+    Extras &extras()
+    {
+        if (!mExtras) {
+            mExtras = std::make_unique<Extras>();
+        }
+        return *mExtras;
+    }
+
+    // Mangled name of the executor type, demangled only when it is printed
+    const char *mExecutorName;
+    std::unique_ptr<Extras> mExtras;
+    Scheduler *mScheduler = nullptr;
+    int mTimeout = 0;
+    MetricsCounters *mMetrics = nullptr;
     ExecutorBasePtr mPrev;
 };
 
+/*
+ * The executors of a job from the last one to the first one, and the guards
+ * and progress weight their executions share. Collected once, the chain can
+ * set up any number of executions without walking the executors again.
+ *
+ * Only holds pointers into the executors, @p last must outlive the chain.
+ */
+class KASYNC_EXPORT ExecutionChain
+{
+public:
+    explicit ExecutionChain(const ExecutorBasePtr &last);
+
+    // Sets up the executions of the whole chain
+    ExecutionPtr exec(const QSharedPointer<Private::ExecutionContext> &context) const;
+
+    // Sets up the executions of the whole chain, passing @p in to the first executor
+    template<typename In>
+    ExecutionPtr execWith(In &&in) const
+    {
+        // The initial value is handed to the first executor through the context,
+        // so the executor chain itself is never modified by an execution.
+        using InType = std::decay_t<In>;
+        auto context = ExecutionContext::Ptr::create();
+        context->input = ExecutorBase::createExecution<InType>(ExecutorBasePtr());
+        context->input->result<InType>()->setResult(std::forward<In>(in));
+        return exec(context);
+    }
+
+private:
+    QVarLengthArray<const ExecutorBasePtr *, 16> mExecutors;
+    QVector<QPointer<const QObject>> mGuards;
+    qreal mProgressWeight = 0;
+};
+
 template<typename Out, typename ... In>
 class Executor : public ExecutorBase
 {
@@ -94,11 +197,10 @@ class Executor : public ExecutorBase
 public:
     explicit Executor(ContinuationHolder<Out, In ...> &&workerHelper, const ExecutorBasePtr &parent = {},
                       ExecutionFlag executionFlag = ExecutionFlag::GoodCase)
-        : ExecutorBase(parent)
+        : ExecutorBase(parent, typeid(Executor).name())
         , mContinuationHolder(std::move(workerHelper))
         , executionFlag(executionFlag)
     {
-        STORE_EXECUTOR_NAME("Executor", Out, In ...);
     }
 
     virtual ~Executor() = default;
@@ -114,35 +216,30 @@ public:
         //Execute one of the available workers
         KAsync::Future<Out> *future = execution->result<Out>();
 
-        const auto &continuation = Executor<Out, In ...>::mContinuationHolder;
-        if (continuationIs<AsyncContinuation<Out, In ...>>(continuation)) {
-            continuationGet<AsyncContinuation<Out, In ...>>(continuation)(prevFuture ? prevFuture->value() : In() ..., *future);
-        } else if (continuationIs<AsyncErrorContinuation<Out, In ...>>(continuation)) {
-            continuationGet<AsyncErrorContinuation<Out, In ...>>(continuation)(
-                    prevFuture->hasError() ? prevFuture->errors().first() : Error(),
-                    prevFuture ? prevFuture->value() : In() ..., *future);
-        } else if (continuationIs<SyncContinuation<Out, In ...>>(continuation)) {
-            callAndApply(prevFuture ? prevFuture->value() : In() ...,
-                         continuationGet<SyncContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
-            future->setFinished();
-        } else if (continuationIs<SyncErrorContinuation<Out, In ...>>(continuation)) {
-            assert(prevFuture);
-            callAndApply(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
-                         prevFuture ? prevFuture->value() : In() ...,
-                         continuationGet<SyncErrorContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
-            future->setFinished();
-        } else if (continuationIs<JobContinuation<Out, In ...>>(continuation)) {
-            executeJobAndApply(prevFuture ? prevFuture->value() : In() ...,
-                               continuationGet<JobContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
-        } else if (continuationIs<JobErrorContinuation<Out, In ...>>(continuation)) {
-            executeJobAndApply(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
-                               prevFuture ? prevFuture->value() : In() ...,
-                               continuationGet<JobErrorContinuation<Out, In ...>>(continuation), *future, std::is_void<Out>());
-        }
-
+        std::visit([&](const auto &continuation) {
+            using Continuation = std::decay_t<decltype(continuation)>;
+            if constexpr (std::is_same<Continuation, AsyncContinuation<Out, In ...>>::value) {
+                continuation(takeOrCopyValue<In>(prevFuture) ..., *future);
+            } else if constexpr (std::is_same<Continuation, AsyncErrorContinuation<Out, In ...>>::value) {
+                continuation(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
+                             takeOrCopyValue<In>(prevFuture) ..., *future);
+            } else if constexpr (std::is_same<Continuation, JobContinuation<Out, In ...>>::value) {
+                executeJobAndApply(takeOrCopyValue<In>(prevFuture) ..., continuation, *future, std::is_void<Out>());
+            } else if constexpr (std::is_same<Continuation, JobErrorContinuation<Out, In ...>>::value) {
+                executeJobAndApply(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
+                                   takeOrCopyValue<In>(prevFuture) ..., continuation, *future, std::is_void<Out>());
+            } else if (mScheduler) { // Sync continuations
+                runOnScheduler(execution);
+            } else {
+                callSync(execution);
+                future->setFinished();
+            }
+        }, mContinuationHolder);
     }
 
-    ExecutionPtr exec(const ExecutorBasePtr &self, QSharedPointer<Private::ExecutionContext> context) override
+protected:
+    ExecutionPtr setupExecution(const ExecutorBasePtr &self, const ExecutionPtr &prevExecution,
+                                const QSharedPointer<Private::ExecutionContext> &context) override
     {
         /*
          * One executor per job, created with the construction of the Job object.
@@ -155,58 +252,76 @@ public:
 
         // Passing 'self' to execution ensures that the Executor chain remains
         // valid until the entire execution is finished
-        ExecutionPtr execution = ExecutionPtr::create(self);
+        ExecutionPtr execution = ExecutorBase::createExecution<Out>(self);
 #ifndef QT_NO_DEBUG
         execution->tracer = std::make_unique<Tracer>(execution.data()); // owned by execution
 #endif
 
-        context->guards += mGuards;
+        // chainup, the previous execution has already been set up by ExecutionChain::exec()
+        execution->prevExecution = prevExecution;
+        execution->context = context;
+        if (tracingEnabled.load(std::memory_order_relaxed)) {
+            traceSetup(execution.data());
+        }
 
-        // chainup
-        execution->prevExecution = mPrev ? mPrev->exec(mPrev, context) : ExecutionPtr();
+        //We watch our own future to finish the execution once we're done.
+        //The callback keeps the execution alive until then.
+        execution->resultBase->onFinished([execution]() {
+            execution->setFinished();
+        });
 
-        execution->resultBase = ExecutorBase::createFuture<Out>(execution);
-        //We watch our own future to finish the execution once we're done
-        auto fw = new KAsync::FutureWatcher<Out>();
-        QObject::connect(fw, &KAsync::FutureWatcher<Out>::futureReady,
-                         [fw, execution]() {
-                             execution->setFinished();
-                             delete fw;
-                         });
-        fw->setFuture(*execution->result<Out>());
+        return execution;
+    }
 
+    void startExecution(const ExecutionPtr &execution) override
+    {
+        const auto &context = execution->context;
         KAsync::Future<PrevOut> *prevFuture = execution->prevExecution ? execution->prevExecution->result<PrevOut>()
                                                                        : nullptr;
-        if (!prevFuture || prevFuture->isFinished()) { //The previous job is already done
+        if (!prevFuture) {
+            if (statsEnabled.load(std::memory_order_relaxed)) {
+                statsReady(execution.data());
+            }
             runExecution(prevFuture, execution, context->guardIsBroken());
-        } else { //The previous job is still running and we have to wait for it's completion
-            auto prevFutureWatcher = new KAsync::FutureWatcher<PrevOut>();
-            QObject::connect(prevFutureWatcher, &KAsync::FutureWatcher<PrevOut>::futureReady,
-                             [prevFutureWatcher, execution, this, context]() {
-                                 auto prevFuture = prevFutureWatcher->future();
-                                 assert(prevFuture.isFinished());
-                                 delete prevFutureWatcher;
-                                 runExecution(&prevFuture, execution, context->guardIsBroken());
-                             });
-
-            prevFutureWatcher->setFuture(*static_cast<KAsync::Future<PrevOut>*>(prevFuture));
+        } else { //Run once the previous job has completed, or right away if it is already done
+            prevFuture->onFinished([execution, this, context]() {
+                if (statsEnabled.load(std::memory_order_relaxed)) {
+                    statsReady(execution.data());
+                }
+                auto resume = [execution, this, context]() {
+                    auto prevFuture = execution->prevExecution->result<PrevOut>();
+                    assert(prevFuture->isFinished());
+                    runExecution(prevFuture, execution, context->guardIsBroken());
+                };
+                if (batchCompletions.load(std::memory_order_relaxed)) {
+                    enqueueCompletion(std::move(resume));
+                } else {
+                    resume();
+                }
+            });
         }
-
-        return execution;
     }
 
 private:
-    void runExecution(const KAsync::Future<PrevOut> *prevFuture, const ExecutionPtr &execution, bool guardIsBroken)
+    void runExecution(KAsync::Future<PrevOut> *prevFuture, const ExecutionPtr &execution, bool guardIsBroken)
     {
         if (guardIsBroken) {
             execution->resultBase->setFinished();
             return;
         }
+        if (execution->context->canceled) {
+            // Keep the reason the execution was stopped, if there is one
+            if (prevFuture && prevFuture->hasError()) {
+                execution->resultBase->setCanceled(prevFuture->errors().first());
+            } else {
+                execution->resultBase->setCanceled();
+            }
+            return;
+        }
         if (prevFuture) {
             if (prevFuture->hasError() && executionFlag == ExecutionFlag::GoodCase) {
-                //Propagate the error to the outer Future
-                Q_ASSERT(prevFuture->errors().size() == 1);
-                execution->resultBase->setError(prevFuture->errors().first());
+                //Propagate the errors to the outer Future
+                execution->resultBase->setErrors(prevFuture->errors());
                 return;
             }
             if (!prevFuture->hasError() && executionFlag == ExecutionFlag::ErrorCase) {
@@ -216,28 +331,100 @@ private:
                 return;
             }
         }
-        run(execution);
+        if (mTimeout > 0) {
+            startTimeout(execution);
+        }
+        if (mMetrics) {
+            metricsBegin(execution.data(), mMetrics);
+        }
+        const bool stats = statsEnabled.load(std::memory_order_relaxed);
+        if (stats) {
+            statsBegin(execution.data());
+        }
+        if (tracingEnabled.load(std::memory_order_relaxed)) {
+            traceBegin(execution.data());
+            TraceScope scope(execution.data());
+            run(execution);
+        } else {
+            run(execution);
+        }
+        if (stats) {
+            statsReturned(execution.data());
+        }
+    }
+
+    void startTimeout(const ExecutionPtr &execution)
+    {
+        const auto deadline = addDeadline(mTimeout, [weakExecution = execution.toWeakRef()]() {
+            // A finished execution is gone already
+            const auto execution = weakExecution.toStrongRef();
+            if (execution && !execution->resultBase->isFinished()) {
+                // Only this task is canceled, the following ones see the
+                // TimeoutError like any other error and may handle it
+                execution->resultBase->setCanceled(Error(TimeoutError, QStringLiteral("Timeout")));
+            }
+        });
+        if (!deadline) {
+            return;
+        }
+        // The future may be finished in another thread, the removal is
+        // posted to this one then
+        execution->resultBase->onFinished([deadline]() {
+            removeDeadline(deadline);
+        });
+    }
+
+    void callSync(const ExecutionPtr &execution)
+    {
+        KAsync::Future<PrevOut> *prevFuture = execution->prevExecution ? execution->prevExecution->result<PrevOut>()
+                                                                       : nullptr;
+        KAsync::Future<Out> *future = execution->result<Out>();
+
+        std::visit([&](const auto &continuation) {
+            using Continuation = std::decay_t<decltype(continuation)>;
+            if constexpr (std::is_same<Continuation, SyncContinuation<Out, In ...>>::value) {
+                callAndApply(takeOrCopyValue<In>(prevFuture) ..., continuation, *future, std::is_void<Out>());
+            } else if constexpr (std::is_same<Continuation, SyncErrorContinuation<Out, In ...>>::value) {
+                assert(prevFuture);
+                callAndApply(prevFuture->hasError() ? prevFuture->errors().first() : Error(),
+                             takeOrCopyValue<In>(prevFuture) ..., continuation, *future, std::is_void<Out>());
+            }
+        }, mContinuationHolder);
+    }
+
+    void runOnScheduler(const ExecutionPtr &execution)
+    {
+        // The continuation runs on the scheduler, but the future is finished,
+        // and thus the rest of the chain continued, in the current thread.
+        const QPointer<QObject> threadContext = currentThreadContext();
+        mScheduler->schedule([this, execution, threadContext]() mutable {
+            callSync(execution);
+            invokeInThread(threadContext, [execution = std::move(execution)]() {
+                execution->resultBase->setFinished();
+            });
+        });
     }
 
     void executeJobAndApply(In && ... input, const JobContinuation<Out, In ...> &func,
                             Future<Out> &future, std::false_type)
     {
-        func(std::forward<In>(input) ...)
-            .template then<void, Out>([&future](const KAsync::Error &error, const Out &v,
+        auto nested = func(std::forward<In>(input) ...)
+            .template then<void, Out>([&future](const KAsync::Error &error, Out v,
                                                 KAsync::Future<void> &f) {
                 if (error) {
                     future.setError(error);
                 } else {
-                    future.setResult(v);
+                    future.setResult(std::move(v));
                 }
                 f.setFinished();
             }).exec();
+        cancelWith(future, nested);
     }
 
     void executeJobAndApply(In && ... input, const JobContinuation<Out, In ...> &func,
                             Future<Out> &future, std::true_type)
     {
-        func(std::forward<In>(input) ...)
+        auto nested = func(std::forward<In>(input) ...)
             .template then<void>([&future](const KAsync::Error &error, KAsync::Future<void> &f) {
                 if (error) {
                     future.setError(error);
@@ -246,27 +433,29 @@ private:
                 }
                 f.setFinished();
             }).exec();
+        cancelWith(future, nested);
     }
 
     void executeJobAndApply(const Error &error, In && ... input, const JobErrorContinuation<Out, In ...> &func,
                             Future<Out> &future, std::false_type)
     {
-        func(error, std::forward<In>(input) ...)
-            .template then<void, Out>([&future](const KAsync::Error &error, const Out &v,
+        auto nested = func(error, std::forward<In>(input) ...)
+            .template then<void, Out>([&future](const KAsync::Error &error, Out v,
                                                 KAsync::Future<void> &f) {
                 if (error) {
                     future.setError(error);
                 } else {
-                    future.setResult(v);
+                    future.setResult(std::move(v));
                 }
                 f.setFinished();
             }).exec();
+        cancelWith(future, nested);
     }
 
     void executeJobAndApply(const Error &error, In && ... input, const JobErrorContinuation<Out, In ...> &func,
                             Future<Out> &future, std::true_type)
     {
-        func(error, std::forward<In>(input) ...)
+        auto nested = func(error, std::forward<In>(input) ...)
             .template then<void>([&future](const KAsync::Error &error, KAsync::Future<void> &f) {
                 if (error) {
                     future.setError(error);
@@ -275,6 +464,17 @@ private:
                 }
                 f.setFinished();
             }).exec();
+        cancelWith(future, nested);
+    }
+
+    // Cancels the nested job when the future of this job gets canceled
+    static void cancelWith(Future<Out> &future, KAsync::Future<void> nested)
+    {
+        if (!nested.isFinished()) {
+            future.onCanceled([nested = std::move(nested)]() mutable {
+                nested.cancel();
+            });
+        }
     }
 
     void callAndApply(In && ... input, const SyncContinuation<Out, In ...> &func, Future<Out> &future, std::false_type)
@@ -297,16 +497,32 @@ private:
         func(error, std::forward<In>(input) ...);
     }
 
+    // The previous future is normally only referenced by its execution, in which
+    // case its value is moved into the next continuation instead of being copied.
+    template<typename T>
+    static T takeOrCopyValue(KAsync::Future<T> *future)
+    {
+        if (!future) {
+            return T();
+        }
+        if constexpr (std::is_copy_constructible<T>::value) {
+            if (future->isShared()) {
+                return future->value();
+            }
+        }
+        return future->takeValue();
+    }
+
     template<typename T>
     std::enable_if_t<!std::is_void<T>::value>
-    copyFutureValue(const KAsync::Future<T> &in, KAsync::Future<T> &out)
+    copyFutureValue(KAsync::Future<T> &in, KAsync::Future<T> &out)
     {
-        out.setValue(in.value());
+        out.setValue(takeOrCopyValue(&in));
     }
 
     template<typename T>
     std::enable_if_t<std::is_void<T>::value>
-    copyFutureValue(const KAsync::Future<T> &, KAsync::Future<T> &)
+    copyFutureValue(KAsync::Future<T> &, KAsync::Future<T> &)
     {
         //noop
     }
@@ -7,8 +7,34 @@
 #include "future.h"
 #include "async.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
 using namespace KAsync;
 
+namespace {
+
+// Shared with the callback, which may run after a waitFor() has timed out
+struct WaitState {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool finished = false;
+};
+
+std::atomic<int> sProgressInterval{0};
+std::atomic<int> sErrorLimit{32};
+
+qint64 now()
+{
+    const auto time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+}
+
+} // namespace
+
 QDebug &operator<<(QDebug &dbg, const Error &error)
 {
     dbg << "Error: " << error.errorCode << "Msg: " << error.errorMessage;
@@ -17,6 +43,7 @@ QDebug &operator<<(QDebug &dbg, const Error &error)
 
 FutureBase::PrivateBase::PrivateBase(const Private::ExecutionPtr &execution)
     : finished(false)
+    , canceled(false)
     , mExecution(execution)
 {
 }
@@ -35,6 +62,11 @@ void FutureBase::PrivateBase::releaseExecution()
     mExecution.clear();
 }
 
+Private::ExecutionPtr FutureBase::PrivateBase::execution() const
+{
+    return mExecution.toStrongRef();
+}
+
 
 
 FutureBase::FutureBase()
@@ -63,16 +95,33 @@ void FutureBase::releaseExecution()
 
 void FutureBase::setFinished()
 {
-    if (isFinished()) {
-        return;
+    QVector<QPointer<FutureWatcherBase>> watchers;
+    QVector<std::function<void()>> cancelHandlers;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->finished) {
+            return;
+        }
+        d->finished = true;
+        watchers = d->watchers;
+        // Can't be canceled anymore, the handlers are released outside of the lock
+        cancelHandlers.swap(d->cancelHandlers);
+    }
+    // No callbacks can be added anymore once finished is set. The callbacks
+    // keep the executions alive, and thus this future, until they are cleared
+    // below. Not taking a reference before that lets the next continuation
+    // move the value out of this future.
+    for (const auto &callback : d->callbacks) {
+        callback();
     }
-    d->finished = true;
-    //TODO this could directly call the next continuation with the value, and thus avoid unnecessary copying.
-    for (auto watcher : d->watchers) {
+    for (auto watcher : watchers) {
         if (watcher) {
             watcher->futureReadyCallback();
         }
     }
+    // Clearing the callbacks may end the execution owning this future
+    const QExplicitlySharedDataPointer<PrivateBase> dd = d;
+    dd->callbacks.clear();
 }
 
 bool FutureBase::isFinished() const
@@ -80,27 +129,77 @@ bool FutureBase::isFinished() const
     return d->finished;
 }
 
+void FutureBase::wait() const
+{
+    waitFor(-1);
+}
+
+bool FutureBase::waitFor(int msecs) const
+{
+    const auto state = std::make_shared<WaitState>();
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->finished) {
+            return true;
+        }
+        d->callbacks.append([state]() {
+            {
+                std::lock_guard<std::mutex> locker(state->mutex);
+                state->finished = true;
+            }
+            state->condition.notify_all();
+        });
+    }
+
+    std::unique_lock<std::mutex> locker(state->mutex);
+    const auto finished = [&state]() {
+        return state->finished;
+    };
+    if (msecs < 0) {
+        state->condition.wait(locker, finished);
+        return true;
+    }
+    return state->condition.wait_for(locker, std::chrono::milliseconds(msecs), finished);
+}
+
 void FutureBase::setError(int code, const QString &message)
 {
-    d->errors.clear();
-    addError(Error(code, message));
-    setFinished();
+    setErrors({Error(code, message)});
 }
 
 void FutureBase::setError(const Error &error)
 {
-    d->errors.clear();
-    addError(error);
+    setErrors({error});
+}
+
+void FutureBase::setErrors(const QVector<Error> &errors)
+{
+    {
+        QMutexLocker locker(&d->mutex);
+        // Keep the CanceledError, a cancel() from another thread may have won
+        if (d->finished || d->canceled) {
+            return;
+        }
+        d->errors = errors;
+    }
     setFinished();
 }
 
 void FutureBase::addError(const Error &error)
 {
+    QMutexLocker locker(&d->mutex);
+    if (d->finished || d->canceled) {
+        return;
+    }
     d->errors << error;
 }
 
 void FutureBase::clearErrors()
 {
+    QMutexLocker locker(&d->mutex);
+    if (d->finished || d->canceled) {
+        return;
+    }
     d->errors.clear();
 }
 
@@ -137,18 +236,164 @@ void FutureBase::setProgress(int processed, int total)
 
 void FutureBase::setProgress(qreal progress)
 {
-    for (auto watcher : d->watchers) {
+    // Pass the progress on to the Future of the whole chain, each task
+    // covering its share after the tasks before it
+    const Private::ExecutionPtr execution = d->execution();
+    if (execution && execution->context) {
+        const auto last = execution->context->last.toStrongRef();
+        if (last && last != execution && last->resultBase && execution->context->progressWeight > 0) {
+            const qreal weight = execution->executor->progressWeight();
+            last->resultBase->setProgress((execution->progressOffset + progress * weight) / execution->context->progressWeight);
+        }
+    }
+
+    qint64 wait = 0;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->watchers.isEmpty()) {
+            return;
+        }
+        d->progress = progress;
+        const int interval = sProgressInterval.load(std::memory_order_relaxed);
+        if (interval > 0) {
+            if (d->progressPending) {
+                // Picked up by the pending notification
+                return;
+            }
+            wait = d->progressTime + interval - now();
+            // Claims the notification, the deadline is added without the lock
+            d->progressPending = wait > 0;
+        }
+    }
+    if (wait > 0) {
+        const auto deadline = Private::addDeadline(static_cast<int>(wait), [dd = d]() {
+            notifyProgress(dd);
+        });
+        // Without an event loop the progress is passed on right away
+        if (deadline) {
+            return;
+        }
+    }
+    notifyProgress(d);
+}
+
+void FutureBase::notifyProgress(const QExplicitlySharedDataPointer<PrivateBase> &d)
+{
+    QVector<QPointer<FutureWatcherBase>> watchers;
+    qreal progress;
+    {
+        QMutexLocker locker(&d->mutex);
+        d->progressPending = false;
+        if (d->finished) {
+            return;
+        }
+        d->progressTime = now();
+        progress = d->progress;
+        watchers = d->watchers;
+    }
+    for (auto watcher : watchers) {
         if (watcher) {
             watcher->futureProgressCallback(progress);
         }
     }
 }
 
+void KAsync::setProgressInterval(int msecs)
+{
+    sProgressInterval.store(msecs, std::memory_order_relaxed);
+}
+
+void KAsync::setErrorLimit(int limit)
+{
+    sErrorLimit.store(std::max(limit, 1), std::memory_order_relaxed);
+}
+
+int KAsync::errorLimit()
+{
+    return sErrorLimit.load(std::memory_order_relaxed);
+}
+
+
+
+void FutureBase::cancel()
+{
+    const Private::ExecutionPtr execution = d->execution();
+    if (!execution || !execution->context) {
+        setCanceled();
+        return;
+    }
+
+    // The following tasks are skipped once they see the canceled context, so
+    // only the task that is currently running, whose previous task has
+    // finished, needs to be canceled.
+    execution->context->canceled = true;
+    for (auto e = execution; e; e = e->prevExecution) {
+        if (!e->prevExecution || !e->prevExecution->resultBase || e->prevExecution->resultBase->isFinished()) {
+            if (e->resultBase) {
+                e->resultBase->setCanceled();
+            }
+            break;
+        }
+    }
+}
+
+bool FutureBase::isCanceled() const
+{
+    return d->canceled;
+}
+
+void FutureBase::onCanceled(std::function<void()> &&handler)
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->finished) {
+        d->cancelHandlers.append(std::move(handler));
+    }
+}
+
+void FutureBase::setCanceled(const Error &reason)
+{
+    QVector<std::function<void()>> cancelHandlers;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->finished || d->canceled) {
+            return;
+        }
+        d->canceled = true;
+        d->errors.clear();
+        d->errors << reason;
+        cancelHandlers.swap(d->cancelHandlers);
+    }
+    for (const auto &handler : cancelHandlers) {
+        handler();
+    }
+    setFinished();
+}
+
+void FutureBase::onFinished(std::function<void()> &&callback)
+{
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->finished) {
+            d->callbacks.append(std::move(callback));
+            return;
+        }
+    }
+    callback();
+}
 
+bool FutureBase::isShared() const
+{
+    return d->ref.loadAcquire() > 1;
+}
 
-void FutureBase::addWatcher(FutureWatcherBase* watcher)
+bool FutureBase::addWatcher(FutureWatcherBase* watcher)
 {
+    QMutexLocker locker(&d->mutex);
+    if (d->finished) {
+        return false;
+    }
     d->watchers.append(QPointer<FutureWatcherBase>(watcher));
+    return true;
 }
 
 
@@ -179,8 +424,7 @@ void FutureWatcherBase::futureProgressCallback(qreal progress)
 void FutureWatcherBase::setFutureImpl(const FutureBase &future)
 {
     d->future = future;
-    d->future.addWatcher(this);
-    if (future.isFinished()) {
+    if (!d->future.addWatcher(this)) {
         futureReadyCallback();
     }
 }
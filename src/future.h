@@ -12,10 +12,14 @@
 
 class QEventLoop;
 
+#include <atomic>
+#include <functional>
 #include <type_traits>
 
+#include <QMutex>
 #include <QSharedDataPointer>
 #include <QPointer>
+#include <QVarLengthArray>
 #include <QVector>
 #include <QEventLoop>
 
@@ -30,10 +34,31 @@ class FutureWatcher;
 namespace Private {
 struct Execution;
 class ExecutorBase;
+template<typename Out, typename ... In>
+class Executor;
+template<typename Futures, typename Out>
+struct WhenState;
+template<typename T, bool Settled>
+class FutureAwaiter;
+template<typename Key, typename T>
+class SharedState;
+template<typename List, typename In, typename Out>
+struct BatchState;
 
 typedef QSharedPointer<Execution> ExecutionPtr;
 } // namespace Private
 
+/**
+ * @ingroup Future
+ *
+ * Error codes reported by KAsync itself. They are negative so they don't clash
+ * with the error codes used by jobs.
+ */
+enum ErrorCode {
+    CanceledError = -1, ///< The execution has been canceled, see Future::cancel()
+    TimeoutError = -2 ///< A job did not finish in time, see Job::timeout()
+};
+
 struct KASYNC_EXPORT Error
 {
     Error() : errorCode(0) {};
@@ -63,10 +88,51 @@ private:
     operator T() const;
 };
 
+/**
+ * @ingroup Future
+ *
+ * Limits how often FutureWatcher::futureProgress() is emitted for a Future to
+ * once per @p msecs milliseconds. Progress reported in between is coalesced,
+ * the watchers receive the latest value once the interval has passed.
+ *
+ * The delayed progress is delivered by the event loop of the thread that
+ * reported it. In threads without an event loop every update is passed on
+ * right away. The default of 0 passes on every update.
+ */
+KASYNC_EXPORT void setProgressInterval(int msecs);
+
+/**
+ * @ingroup Future
+ *
+ * Sets how many errors the combinators running jobs in parallel, like
+ * forEach(), map() and whenAll(), collect in their Future. Further errors are
+ * dropped. The default is 32.
+ *
+ * @see FutureBase::errors()
+ */
+KASYNC_EXPORT void setErrorLimit(int limit);
+
+/**
+ * @ingroup Future
+ *
+ * Returns the limit set with setErrorLimit().
+ */
+KASYNC_EXPORT int errorLimit();
+
 class KASYNC_EXPORT FutureBase
 {
     friend struct KAsync::Private::Execution;
     friend class FutureWatcherBase;
+    template<typename Out, typename ... In>
+    friend class KAsync::Private::Executor;
+    template<typename Futures, typename Out>
+    friend struct KAsync::Private::WhenState;
+    template<typename T, bool Settled>
+    friend class KAsync::Private::FutureAwaiter;
+    template<typename Key, typename T>
+    friend class KAsync::Private::SharedState;
+    template<typename List, typename In, typename Out>
+    friend struct KAsync::Private::BatchState;
 
 public:
     virtual ~FutureBase();
@@ -74,9 +140,12 @@ public:
 
     void setFinished();
     bool isFinished() const;
+    void wait() const;
+    bool waitFor(int msecs) const;
 
     void setError(int code = 1, const QString &message = QString());
     void setError(const Error &error);
+    void setErrors(const QVector<Error> &errors);
     void addError(const Error &error);
     void clearErrors();
     bool hasError() const;
@@ -87,6 +156,10 @@ public:
     void setProgress(qreal progress);
     void setProgress(int processed, int total);
 
+    void cancel();
+    bool isCanceled() const;
+    void onCanceled(std::function<void()> &&handler);
+
 protected:
     class KASYNC_EXPORT PrivateBase : public QSharedData
     {
@@ -95,11 +168,23 @@ protected:
         virtual ~PrivateBase();
 
         void releaseExecution();
+        KAsync::Private::ExecutionPtr execution() const;
 
-        bool finished;
+        std::atomic<bool> finished;
+        std::atomic<bool> canceled;
         QVector<Error> errors;
 
+        // Protects finished, canceled, the callbacks and watchers, the future
+        // may be finished or canceled from another thread
+        QMutex mutex;
+        // Used by the executors to chain up, which is a lot cheaper than going through a FutureWatcher
+        QVarLengthArray<std::function<void()>, 2> callbacks;
+        QVector<std::function<void()>> cancelHandlers;
         QVector<QPointer<FutureWatcherBase>> watchers;
+        // Latest progress, and when it was last passed on to the watchers
+        qreal progress = 0;
+        qint64 progressTime = 0;
+        bool progressPending = false;
     private:
         QWeakPointer<KAsync::Private::Execution> mExecution;
     };
@@ -109,9 +194,19 @@ protected:
     FutureBase(const FutureBase &other);
     FutureBase &operator=(const FutureBase &other) = default;
 
-    void addWatcher(KAsync::FutureWatcherBase *watcher);
+    // Returns false, without adding the watcher, if the future is already finished
+    bool addWatcher(KAsync::FutureWatcherBase *watcher);
+    // Invokes the callback once the future is finished, or immediately if already finished
+    void onFinished(std::function<void()> &&callback);
+    // Whether any other Future shares the state of this one
+    bool isShared() const;
+    // Invokes the cancel handlers and finishes the future with @p reason
+    void setCanceled(const Error &reason = Error(CanceledError, QStringLiteral("Canceled")));
     void releaseExecution();
 
+private:
+    static void notifyProgress(const QExplicitlySharedDataPointer<PrivateBase> &d);
+
 protected:
     QExplicitlySharedDataPointer<PrivateBase> d;
 };
@@ -221,16 +316,39 @@ public:
         dataImpl()->value = value;
     }
 
+    /**
+     * @overload
+     */
+    void setValue(T &&value)
+    {
+        dataImpl()->value = std::move(value);
+    }
+
     /**
      * Retrieve the result of the Future. Calling this method when the future has
      * not yet finished (i.e. isFinished() returns false)
      * returns undefined result.
+     *
+     * For move-only types a reference to the value is returned instead.
      */
-    T value() const
+    std::conditional_t<std::is_copy_constructible<T>::value, T, const T &> value() const
     {
         return dataImpl()->value;
     }
 
+    /**
+     * Moves the result out of the Future. Afterwards the Future, and all its
+     * copies, only hold a moved-from value.
+     *
+     * Use this instead of value() to avoid copying large or move-only results.
+     *
+     * @see value()
+     */
+    T takeValue()
+    {
+        return std::move(dataImpl()->value);
+    }
+
     T *operator->()
     {
         return &(dataImpl()->value);
@@ -257,12 +375,36 @@ public:
      *
      * @note Internally this method is using a nested QEventLoop, which can
      * in some situation cause problems and deadlocks. It is recommended to use
-     * FutureWatcher.
+     * FutureWatcher, or wait() in threads without an event loop.
      *
-     * @see isFinished()
+     * @see isFinished(), wait()
      */
     void waitForFinished() const;
 
+    /**
+     * Blocks the current thread until the Future has finished.
+     *
+     * Unlike waitForFinished() this does not run an event loop, so it can be
+     * used from threads that have none, like the workers of a QThreadPool,
+     * and no other events are processed while waiting. Jobs executed in such
+     * a thread don't depend on its events. The Future must be finished by
+     * another thread, waiting for a job that continues from the running event
+     * loop of the current thread blocks forever.
+     *
+     * @see waitFor(), isFinished()
+     */
+    void wait() const;
+
+    /**
+     * Blocks the current thread until the Future has finished, for at most
+     * @p msecs milliseconds. Returns whether the Future has finished.
+     *
+     * A negative @p msecs waits without a time limit, like wait().
+     *
+     * @see wait()
+     */
+    bool waitFor(int msecs) const;
+
     /**
      * Marks the future as finished. This will cause all FutureWatcher&lt;T&gt;
      * objects watching this particular instance to emit FutureWatcher::futureReady()
@@ -301,6 +443,16 @@ public:
      */
     void setError(int code = 1, const QString &message = QString());
 
+    /**
+     * Like setError(), but reports several errors at once, for example those
+     * of the jobs of a loop. errorCode() and errorMessage() return the first
+     * one, errors() all of them.
+     *
+     * @warning This method must only be called by the tasks inside Job,
+     * never by outside users.
+     */
+    void setErrors(const QVector<Error> &errors);
+
     /**
      * Returns error code set via setError() or 0 if no
      * error has occurred.
@@ -320,7 +472,11 @@ public:
     /**
      * Sets progress of the task. All FutureWatcher instances watching
      * this particular future will then emit FutureWatcher::futureProgress()
-     * signal.
+     * signal, at most as often as set with KAsync::setProgressInterval().
+     *
+     * The progress of a task in a chain of jobs is also reported as progress
+     * of the Future returned by Job::exec(), weighted by the share of the
+     * task in the whole chain, see Job::progressWeight().
      *
      * @param processed Already processed amount
      * @param total Total amount to process
@@ -334,6 +490,40 @@ public:
      */
     void setProgress(qreal progress);
 
+    /**
+     * Cancels the execution this Future belongs to.
+     *
+     * The task that is currently running is notified through the handlers
+     * registered with onCanceled() and finishes with a CanceledError. All
+     * following tasks are skipped, so the Future returned by Job::exec()
+     * finishes with a CanceledError as well.
+     *
+     * Cancelling a Future that has already finished has no effect.
+     *
+     * @see isCanceled(), onCanceled()
+     */
+    void cancel();
+
+    /**
+     * Query whether the Future has been finished because its execution
+     * was canceled.
+     *
+     * @see cancel()
+     */
+    bool isCanceled() const;
+
+    /**
+     * Registers a handler that is invoked when the Future is canceled while it
+     * is not finished yet. Tasks use this to abort pending operations, there is
+     * no need to finish the Future from the handler.
+     *
+     * The handler is invoked in the thread calling cancel() and it is discarded
+     * once the Future has finished.
+     *
+     * @see cancel()
+     */
+    void onCanceled(std::function<void()> &&handler);
+
 #endif // ONLY_DOXYGEN
     void setResult(const T &value)
     {
@@ -341,6 +531,12 @@ public:
         FutureBase::setFinished();
     }
 
+    void setResult(T &&value)
+    {
+        dataImpl()->value = std::move(value);
+        FutureBase::setFinished();
+    }
+
 protected:
     //@cond PRIVATE
     Future(const KAsync::Private::ExecutionPtr &execution)
@@ -12,8 +12,19 @@
 #include "async.h"
 #include "traits_p.h"
 
+#include <QHash>
+#include <QMutex>
 #include <QTimer>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <random>
+#include <tuple>
+#include <variant>
+
 //@cond PRIVATE
 
 namespace KAsync
@@ -68,27 +79,149 @@ inline Job<void> Job<void>::onError(SyncErrorContinuation<void> &&errorFunc) con
 
 template<typename Out, typename ... In>
 template<typename FirstIn>
-KAsync::Future<Out> Job<Out, In ...>::exec(FirstIn in)
+KAsync::Future<Out> Job<Out, In ...>::exec(FirstIn in) const
 {
-    // Inject a fake sync executor that will return the initial value
-    Private::ExecutorBasePtr first = mExecutor;
-    while (first->mPrev) {
-        first = first->mPrev;
+    static_assert(sizeof...(In) == 1, "Only a job with an input parameter can be executed with an argument.");
+    using InType = std::tuple_element_t<0, std::tuple<In ...>>;
+
+    Private::ExecutionPtr execution = Private::ExecutionChain(mExecutor).execWith(InType(std::move(in)));
+    return *execution->result<Out>();
+}
+
+namespace Private {
+
+/*
+ * Executes a job for each input of a list, see Job::execBatch(). Like
+ * ForEachState, but the executions are set up from one collected chain
+ * instead of through a wrapper job per input.
+ */
+template<typename List, typename In, typename Out>
+struct BatchState
+{
+    using Output = std::conditional_t<std::is_void<Out>::value, void, QVector<Out>>;
+
+    BatchState(const ExecutorBasePtr &executor, List &&list, const BatchOptions &options,
+               const KAsync::Future<Output> &future)
+        : executor(executor)
+        , chain(this->executor)
+        , inputs(std::move(list))
+        , next(inputs.cbegin())
+        , options(options)
+        , future(future)
+    {
+        if constexpr (!std::is_void<Out>::value) {
+            results.resize(static_cast<int>(inputs.size()));
+        }
     }
 
-    first->mPrev = QSharedPointer<Private::Executor<FirstIn>>::create(
-            Private::ContinuationHolder<FirstIn>([val = std::move(in)](Future<FirstIn> &future) {
-                 future.setResult(val);
-            }));
+    bool stopped() const
+    {
+        return (!errors.isEmpty() && options.errorPolicy == StopOnError) || future.isCanceled();
+    }
 
-    auto result = exec();
-    // Remove the injected executor
-    first->mPrev.reset();
-    return result;
+    static void cancel(const QSharedPointer<BatchState> &state)
+    {
+        // Iterate over a copy, canceling runs arbitrary handlers of the executions
+        const auto running = state->inFlight.values();
+        for (auto execution : running) {
+            execution.cancel();
+        }
+    }
+
+    static void schedule(const QSharedPointer<BatchState> &state)
+    {
+        // Executions that finish synchronously end up here again from within
+        // the loop below, the loop picks up the freed slot instead of recursing.
+        if (state->scheduling) {
+            return;
+        }
+        state->scheduling = true;
+        while (state->running < state->options.maxConcurrency && state->next != state->inputs.cend() && !state->stopped()) {
+            const auto id = state->lastId++;
+            state->running++;
+            KAsync::Future<Out> result = *state->chain.execWith(In(*state->next++))->template result<Out>();
+            if (!result.isFinished()) {
+                state->inFlight.insert(id, result);
+            }
+            result.onFinished([state, id, result]() mutable {
+                finished(state, id, result);
+            });
+        }
+        state->scheduling = false;
+
+        if (state->running == 0 && (state->next == state->inputs.cend() || state->stopped())
+                && !state->future.isFinished()) {
+            if (!state->errors.isEmpty()) {
+                state->future.setErrors(state->errors);
+            } else if constexpr (std::is_void<Out>::value) {
+                state->future.setFinished();
+            } else {
+                state->future.setResult(std::move(state->results));
+            }
+        }
+    }
+
+    static void finished(const QSharedPointer<BatchState> &state, quint64 id, KAsync::Future<Out> &result)
+    {
+        if (result.hasError()) {
+            const auto resultErrors = result.errors();
+            for (const auto &error : resultErrors) {
+                if (state->errors.size() == errorLimit()) {
+                    break;
+                }
+                state->errors.append(error);
+            }
+        } else if constexpr (!std::is_void<Out>::value) {
+            // Inputs are started in order, so the id is also the index
+            state->results[static_cast<int>(id)] = result.takeValue();
+        }
+        state->inFlight.remove(id);
+        state->running--;
+        state->future.setProgress(static_cast<int>(++state->done), static_cast<int>(state->inputs.size()));
+        schedule(state);
+    }
+
+    // Keeps the executors alive, the chain points into them
+    const ExecutorBasePtr executor;
+    const ExecutionChain chain;
+    const List inputs;
+    typename List::const_iterator next;
+    const BatchOptions options;
+    KAsync::Future<Output> future;
+    QVector<KAsync::Error> errors;
+    std::conditional_t<std::is_void<Out>::value, std::nullptr_t, QVector<Out>> results;
+    QHash<quint64, KAsync::Future<Out>> inFlight;
+    quint64 lastId = 0;
+    quint64 done = 0;
+    int running = 0;
+    bool scheduling = false;
+};
+
+} // namespace Private
+
+template<typename Out, typename ... In>
+template<typename List>
+KAsync::Future<std::conditional_t<std::is_void<Out>::value, void, QVector<Out>>>
+Job<Out, In ...>::execBatch(List inputs, const BatchOptions &options) const
+{
+    static_assert(sizeof...(In) == 1, "Only a job with an input parameter can be executed with a batch of inputs.");
+    using InType = std::tuple_element_t<0, std::tuple<In ...>>;
+    using State = Private::BatchState<List, InType, Out>;
+    Q_ASSERT(options.maxConcurrency > 0);
+
+    KAsync::Future<typename State::Output> future;
+    auto state = QSharedPointer<State>::create(mExecutor, std::move(inputs), options, future);
+    future.onCanceled([weakState = state.toWeakRef()]() {
+        if (auto state = weakState.toStrongRef()) {
+            State::cancel(state);
+        }
+    });
+    State::schedule(state);
+    return future;
 }
 
 template<typename Out, typename ... In>
-KAsync::Future<Out> Job<Out, In ...>::exec()
+KAsync::Future<Out> Job<Out, In ...>::exec() const
 {
     Private::ExecutionPtr execution = mExecutor->exec(mExecutor, Private::ExecutionContext::Ptr::create());
     KAsync::Future<Out> result = *execution->result<Out>();
@@ -133,110 +266,427 @@ auto Job<Out, In ...>::thenInvariants() const -> std::enable_if_t<(sizeof...(InO
 {
 }
 
-template<template<typename> class Container>
-KAsync::Job<void> waitForCompletion(Container<KAsync::Future<void>> &futures)
+namespace Private {
+
+/*
+ * Shared state of whenAll() and whenAny().
+ *
+ * The futures may finish in any thread, so instead of a watcher per future
+ * the state only counts the ones that are still pending.
+ */
+template<typename Futures, typename Out>
+struct WhenState
 {
-    struct Context {
-        void removeWatcher(KAsync::FutureWatcher<void> *w)
-        {
-            pending.erase(std::remove_if(pending.begin(), pending.end(), [w](const auto &watcher) {
-                return w == watcher.get();
-            }));
+    WhenState(const Futures &futures, const KAsync::Future<Out> &future)
+        : futures(futures)
+        , future(future)
+    {}
+
+    template<typename F>
+    void forEachFuture(F &&f)
+    {
+        if constexpr (traits::isContainer<Futures>::value) {
+            for (auto &future : futures) {
+                f(future);
+            }
+        } else {
+            std::apply([&f](auto & ... future) {
+                    (f(future), ...);
+                }, futures);
         }
+    }
 
-        std::vector<std::unique_ptr<KAsync::FutureWatcher<void>>> pending;
-    };
+    // Invokes @p callback once @p future has finished, in the thread finishing it
+    template<typename T>
+    static void watch(KAsync::Future<T> future, std::function<void()> &&callback)
+    {
+        future.onFinished(std::move(callback));
+    }
 
-    return start<Context *>([]() {
-            return new Context();
-        })
-        .template then<Context*, Context*>([futures](Context *context, KAsync::Future<Context *> &future) {
-            for (KAsync::Future<void> subFuture : futures) {
-                if (subFuture.isFinished()) {
-                    continue;
-                }
-                // FIXME bind lifetime all watcher to future (respectively the main job)
-                auto watcher = std::make_unique<KAsync::FutureWatcher<void>>();
-                QObject::connect(watcher.get(), &KAsync::FutureWatcher<void>::futureReady,
-                                 [&future, watcher = watcher.get(), context]() {
-                                    context->removeWatcher(watcher);
-                                    if (context->pending.empty()) {
-                                        future.setResult(context);
-                                    }
-                                });
-                watcher->setFuture(subFuture);
-                context->pending.push_back(std::move(watcher));
+    // Cancels the pending futures along with the combined one
+    static void cancelWith(const QSharedPointer<WhenState> &state)
+    {
+        state->future.onCanceled([weakState = state.toWeakRef()]() {
+            if (auto state = weakState.toStrongRef()) {
+                state->forEachFuture([](FutureBase &future) {
+                    future.cancel();
+                });
             }
-            if (context->pending.empty()) {
-                future.setResult(context);
+        });
+    }
+
+    // Returns true for the caller that finished the last pending future
+    bool release()
+    {
+        return --pending == 0 && !future.isFinished();
+    }
+
+    // Returns true for the caller that finished the first future
+    bool claim()
+    {
+        return !claimed.exchange(true) && !future.isFinished();
+    }
+
+    // The errors of all futures, in their order, up to errorLimit()
+    QVector<KAsync::Error> errors()
+    {
+        QVector<KAsync::Error> errors;
+        const int limit = errorLimit();
+        forEachFuture([&errors, limit](const FutureBase &future) {
+            const auto futureErrors = future.errors();
+            for (const auto &error : futureErrors) {
+                if (errors.size() == limit) {
+                    return;
+                }
+                errors.append(error);
             }
-        })
-        .template then<void, Context*>([](Context *context) {
-            delete context;
         });
-        // .finally<void>([context]() { delete context; });
+        return errors;
+    }
+
+    Futures futures;
+    KAsync::Future<Out> future;
+    // One extra for the setup, so the futures that are already finished
+    // don't finish the combined future before all have been seen
+    std::atomic<int> pending{1};
+    std::atomic<bool> claimed{false};
+};
+
+template<typename Out, typename Futures>
+Job<Out> whenAllImpl(const Futures &futures, const std::function<void(WhenState<Futures, Out> &)> &done)
+{
+    using State = WhenState<Futures, Out>;
+    return start<Out>([futures, done](KAsync::Future<Out> &future) {
+            auto state = QSharedPointer<State>::create(futures, future);
+            State::cancelWith(state);
+            const auto release = [state, done]() {
+                if (state->release()) {
+                    done(*state);
+                }
+            };
+            state->forEachFuture([&](const auto &future) {
+                ++state->pending;
+                State::watch(future, release);
+            });
+            release();
+        });
 }
 
-template<typename List, typename ValueType>
-Job<void, List> forEach(KAsync::Job<void, ValueType> job)
+template<typename Out>
+void setResultOrError(const QVector<KAsync::Error> &errors, KAsync::Future<Out> &future, std::function<Out()> &&result)
 {
-    auto cont = [job] (const List &values) mutable {
-            auto error = QSharedPointer<KAsync::Error>::create();
-            QVector<KAsync::Future<void>> list;
-            for (const auto &v : values) {
-                auto future = job
-                    .template then<void>([error] (const KAsync::Error &e) {
-                        if (e && !*error) {
-                            //TODO ideally we would aggregate the errors instead of just using the first one
-                            *error = e;
-                        }
-                    })
-                    .exec(v);
-                list.push_back(future);
+    if (!errors.isEmpty()) {
+        future.setErrors(errors);
+    } else {
+        future.setResult(result());
+    }
+}
+
+} // namespace Private
+
+template<template<typename> class Container>
+KAsync::Job<void> waitForCompletion(Container<KAsync::Future<void>> &futures)
+{
+    using State = Private::WhenState<Container<KAsync::Future<void>>, void>;
+    return Private::whenAllImpl<void>(futures, std::function<void(State &)>([](State &state) {
+            state.future.setFinished();
+        }));
+}
+
+template<typename T, template<typename> class Container, std::enable_if_t<!std::is_void<T>::value, int>>
+Job<QVector<T>> whenAll(const Container<KAsync::Future<T>> &futures)
+{
+    using State = Private::WhenState<Container<KAsync::Future<T>>, QVector<T>>;
+    return Private::whenAllImpl<QVector<T>>(futures, std::function<void(State &)>([](State &state) {
+            Private::setResultOrError<QVector<T>>(state.errors(), state.future, [&state]() {
+                QVector<T> values;
+                values.reserve(static_cast<int>(state.futures.size()));
+                for (const auto &future : state.futures) {
+                    values.append(future.value());
+                }
+                return values;
+            });
+        }));
+}
+
+template<template<typename> class Container>
+Job<void> whenAll(const Container<KAsync::Future<void>> &futures)
+{
+    using State = Private::WhenState<Container<KAsync::Future<void>>, void>;
+    return Private::whenAllImpl<void>(futures, std::function<void(State &)>([](State &state) {
+            const auto errors = state.errors();
+            if (!errors.isEmpty()) {
+                state.future.setErrors(errors);
+            } else {
+                state.future.setFinished();
+            }
+        }));
+}
+
+template<typename ... T>
+Job<std::tuple<T ...>> whenAll(const KAsync::Future<T> & ... futures)
+{
+    static_assert((!std::is_void<T>::value && ...), "Use the container version of whenAll() for void futures.");
+    using Futures = std::tuple<KAsync::Future<T> ...>;
+    using State = Private::WhenState<Futures, std::tuple<T ...>>;
+    return Private::whenAllImpl<std::tuple<T ...>>(Futures(futures ...), std::function<void(State &)>([](State &state) {
+            Private::setResultOrError<std::tuple<T ...>>(state.errors(), state.future, [&state]() {
+                return std::apply([](const auto & ... future) {
+                        return std::make_tuple(future.value() ...);
+                    }, state.futures);
+            });
+        }));
+}
+
+template<typename T, template<typename> class Container>
+Job<T> whenAny(const Container<KAsync::Future<T>> &futures)
+{
+    using State = Private::WhenState<Container<KAsync::Future<T>>, T>;
+    return start<T>([futures](KAsync::Future<T> &future) {
+            if (futures.empty()) {
+                future.setError(Error("whenAny() needs at least one future"));
+                return;
             }
-            return waitForCompletion(list)
-                .then<void>([error](KAsync::Future<void> &future) {
-                    if (*error) {
-                        future.setError(*error);
+            auto state = QSharedPointer<State>::create(futures, future);
+            State::cancelWith(state);
+            state->forEachFuture([&state](const KAsync::Future<T> &input) {
+                State::watch(input, [state, input]() {
+                    if (!state->claim()) {
+                        return;
+                    }
+                    if (input.hasError()) {
+                        state->future.setErrors(input.errors());
                     } else {
-                        future.setFinished();
+                        if constexpr (!std::is_void<T>::value) {
+                            state->future.setValue(input.value());
+                        }
+                        state->future.setFinished();
                     }
+                    state->forEachFuture([](FutureBase &future) {
+                        future.cancel();
+                    });
                 });
-        };
-    return Job<void, List>(QSharedPointer<Private::Executor<void, List>>::create(
-                Private::ContinuationHolder<void, List>(JobContinuation<void, List>(std::move(cont))), nullptr, Private::ExecutionFlag::GoodCase));
+            });
+        });
 }
 
+namespace Private {
 
-template<typename List, typename ValueType>
-Job<void, List> serialForEach(KAsync::Job<void, ValueType> job)
+template<std::size_t I, typename State>
+void watchAny(const QSharedPointer<State> &state)
 {
-    auto cont = [job] (const List &values) mutable {
-            auto error = QSharedPointer<KAsync::Error>::create();
-            auto serialJob = KAsync::null<void>();
-            for (const auto &value : values) {
-                serialJob = serialJob.then<void>([value, job, error](KAsync::Future<void> &future) {
-                    job.template then<void>([&future, error] (const KAsync::Error &e) {
-                        if (e && !*error) {
-                            //TODO ideally we would aggregate the errors instead of just using the first one
-                            *error = e;
-                        }
-                        future.setFinished();
-                    })
-                    .exec(value);
-                });
+    const auto &input = std::get<I>(state->futures);
+    State::watch(input, [state, input]() {
+        if (!state->claim()) {
+            return;
+        }
+        if (input.hasError()) {
+            state->future.setErrors(input.errors());
+        } else {
+            using Variant = std::remove_reference_t<decltype(state->future.value())>;
+            state->future.setResult(Variant(std::in_place_index<I>, input.value()));
+        }
+        state->forEachFuture([](FutureBase &future) {
+            future.cancel();
+        });
+    });
+}
+
+template<typename State, std::size_t ... I>
+void watchAny(const QSharedPointer<State> &state, std::index_sequence<I ...>)
+{
+    (watchAny<I>(state), ...);
+}
+
+} // namespace Private
+
+template<typename ... T>
+Job<std::variant<T ...>> whenAny(const KAsync::Future<T> & ... futures)
+{
+    static_assert(sizeof...(T) > 0, "whenAny() needs at least one future.");
+    static_assert((!std::is_void<T>::value && ...), "Use the container version of whenAny() for void futures.");
+    using Futures = std::tuple<KAsync::Future<T> ...>;
+    using State = Private::WhenState<Futures, std::variant<T ...>>;
+    return start<std::variant<T ...>>([inputs = Futures(futures ...)](KAsync::Future<std::variant<T ...>> &future) {
+            auto state = QSharedPointer<State>::create(inputs, future);
+            State::cancelWith(state);
+            Private::watchAny(state, std::index_sequence_for<T ...>());
+        });
+}
+
+namespace Private {
+
+// Passes the result of a single value on to the output of a map or reduce loop
+template<typename Output, typename Result>
+struct ForEachCollector
+{
+    using Type = std::function<void(Output &output, quint64 index, Result &&result)>;
+};
+
+template<>
+struct ForEachCollector<void, void>
+{
+    using Type = std::nullptr_t;
+};
+
+/*
+ * Shared state of a bounded forEach, map or reduce loop.
+ *
+ * Keeps at most maxConcurrency executions running and starts the next value from
+ * the completion of a running one, so the window is refilled as jobs finish.
+ * The result of each value is passed to collect() as soon as it is available,
+ * which either stores it in its slot of a buffer that is sized up front (map)
+ * or combines it into the output right away (reduce).
+ */
+template<typename List, typename ValueType, typename Result = void, typename Output = void>
+struct ForEachState
+{
+    ForEachState(const KAsync::Job<Result, ValueType> &job, List &&list, int maxConcurrency,
+                 ErrorPolicy errorPolicy, const KAsync::Future<Output> &future)
+        : job(job)
+        , values(std::move(list))
+        , next(values.cbegin())
+        , maxConcurrency(maxConcurrency)
+        , errorPolicy(errorPolicy)
+        , future(future)
+    {}
+
+    bool stopped() const
+    {
+        return (!errors.isEmpty() && errorPolicy == StopOnError) || future.isCanceled();
+    }
+
+    static void cancel(const QSharedPointer<ForEachState> &state)
+    {
+        // Iterate over a copy, canceling runs arbitrary handlers of the children
+        const auto children = state->inFlight.values();
+        for (auto child : children) {
+            child.cancel();
+        }
+    }
+
+    static void schedule(const QSharedPointer<ForEachState> &state)
+    {
+        // Jobs that finish synchronously end up here again from within the loop
+        // below, the loop picks up the freed slot instead of recursing.
+        if (state->scheduling) {
+            return;
+        }
+        state->scheduling = true;
+        while (state->running < state->maxConcurrency && state->next != state->values.cend() && !state->stopped()) {
+            const auto &value = *state->next++;
+            const auto id = state->lastId++;
+            state->running++;
+            auto child = execChild(state, value, id);
+            if (!child.isFinished()) {
+                state->inFlight.insert(id, child);
             }
-            return serialJob
-                .then<void>([error](KAsync::Future<void> &future) {
-                    if (*error) {
-                        future.setError(*error);
-                    } else {
-                        future.setFinished();
+        }
+        state->scheduling = false;
+
+        if (state->running == 0 && (state->next == state->values.cend() || state->stopped())
+                && !state->future.isFinished()) {
+            if (!state->errors.isEmpty()) {
+                state->future.setErrors(state->errors);
+            } else if constexpr (std::is_void<Output>::value) {
+                state->future.setFinished();
+            } else {
+                state->future.setResult(std::move(state->output));
+            }
+        }
+    }
+
+    // Values are started in order, so the id of a child is also its index
+    static KAsync::Future<void> execChild(const QSharedPointer<ForEachState> &state, const ValueType &value, quint64 id)
+    {
+        if constexpr (std::is_void<Result>::value) {
+            return state->job.template then<void>([state, id](const KAsync::Error &e) {
+                    childFinished(state, id, e);
+                })
+                .exec(value);
+        } else {
+            return state->job.template then<void, Result>([state, id](const KAsync::Error &e, Result result) {
+                    if (!e && !state->stopped()) {
+                        state->collect(state->output, id, std::move(result));
                     }
-                });
-        };
-    return Job<void, List>(QSharedPointer<Private::Executor<void, List>>::create(
-            Private::ContinuationHolder<void, List>(JobContinuation<void, List>(std::move(cont))), nullptr, Private::ExecutionFlag::GoodCase));
+                    childFinished(state, id, e);
+                })
+                .exec(value);
+        }
+    }
+
+    static void childFinished(const QSharedPointer<ForEachState> &state, quint64 id, const KAsync::Error &e)
+    {
+        if (e && state->errors.size() < errorLimit()) {
+            state->errors.append(e);
+        }
+        state->inFlight.remove(id);
+        state->running--;
+        // Every value has the same share of the progress of the loop
+        state->future.setProgress(static_cast<int>(++state->finished), static_cast<int>(state->values.size()));
+        schedule(state);
+    }
+
+    KAsync::Job<Result, ValueType> job;
+    const List values;
+    typename List::const_iterator next;
+    const int maxConcurrency;
+    const ErrorPolicy errorPolicy;
+    KAsync::Future<Output> future;
+    // In the order the children failed, up to errorLimit()
+    QVector<KAsync::Error> errors;
+    std::conditional_t<std::is_void<Output>::value, std::nullptr_t, Output> output;
+    typename ForEachCollector<Output, Result>::Type collect;
+    // Running children, to cancel them along with the loop
+    QHash<quint64, KAsync::Future<void>> inFlight;
+    quint64 lastId = 0;
+    quint64 finished = 0;
+    int running = 0;
+    bool scheduling = false;
+};
+
+// @p init prepares the output and the collector of each execution
+template<typename List, typename ValueType, typename Result, typename Output = void>
+Job<Output, List> forEachImpl(const KAsync::Job<Result, ValueType> &job, int maxConcurrency, ErrorPolicy errorPolicy,
+                              const std::function<void(ForEachState<List, ValueType, Result, Output> &)> &init = {})
+{
+    using State = ForEachState<List, ValueType, Result, Output>;
+    Q_ASSERT(maxConcurrency > 0);
+    return KAsync::start<Output, List>([job, maxConcurrency, errorPolicy, init] (List values, KAsync::Future<Output> &future) {
+            auto state = QSharedPointer<State>::create(job, std::move(values), maxConcurrency, errorPolicy, future);
+            if (init) {
+                init(*state);
+            }
+            future.onCanceled([weakState = state.toWeakRef()]() {
+                if (auto state = weakState.toStrongRef()) {
+                    State::cancel(state);
+                }
+            });
+            State::schedule(state);
+        });
+}
+
+} // namespace Private
+
+template<typename List, typename ValueType>
+Job<void, List> forEach(KAsync::Job<void, ValueType> job)
+{
+    return forEach<List, ValueType>(job, std::numeric_limits<int>::max());
+}
+
+template<typename List, typename ValueType>
+Job<void, List> forEach(KAsync::Job<void, ValueType> job, int maxConcurrency, ErrorPolicy errorPolicy)
+{
+    return Private::forEachImpl<List, ValueType>(job, maxConcurrency, errorPolicy);
+}
+
+
+template<typename List, typename ValueType>
+Job<void, List> serialForEach(KAsync::Job<void, ValueType> job)
+{
+    // A window of one starts each value only once the previous one is done,
+    // without building a chain of jobs for the whole list up front
+    return forEach<List, ValueType>(job, 1, ContinueOnError);
 }
 
 template<typename List, typename ValueType>
@@ -245,12 +695,187 @@ Job<void, List> forEach(JobContinuation<void, ValueType> &&func)
     return forEach<List, ValueType>(KAsync::start<void, ValueType>(std::forward<JobContinuation<void, ValueType>>(func)));
 }
 
+template<typename List, typename ValueType>
+Job<void, List> forEach(JobContinuation<void, ValueType> &&func, int maxConcurrency, ErrorPolicy errorPolicy)
+{
+    return forEach<List, ValueType>(KAsync::start<void, ValueType>(std::forward<JobContinuation<void, ValueType>>(func)),
+                                    maxConcurrency, errorPolicy);
+}
+
 template<typename List, typename ValueType>
 Job<void, List> serialForEach(JobContinuation<void, ValueType> &&func)
 {
     return serialForEach<List, ValueType>(KAsync::start<void, ValueType>(std::forward<JobContinuation<void, ValueType>>(func)));
 }
 
+template<typename List, typename Result, typename ValueType>
+Job<QVector<Result>, List> map(KAsync::Job<Result, ValueType> job)
+{
+    return map<List, Result, ValueType>(job, std::numeric_limits<int>::max());
+}
+
+template<typename List, typename Result, typename ValueType>
+Job<QVector<Result>, List> map(KAsync::Job<Result, ValueType> job, int maxConcurrency, ErrorPolicy errorPolicy)
+{
+    using State = Private::ForEachState<List, ValueType, Result, QVector<Result>>;
+    return Private::forEachImpl<List, ValueType, Result, QVector<Result>>(job, maxConcurrency, errorPolicy, [](State &state) {
+            state.output.resize(state.values.size());
+            state.collect = [](QVector<Result> &results, quint64 index, Result &&result) {
+                results[static_cast<int>(index)] = std::move(result);
+            };
+        });
+}
+
+template<typename List, typename Result, typename ValueType>
+Job<QVector<Result>, List> map(JobContinuation<Result, ValueType> &&func)
+{
+    return map<List, Result, ValueType>(KAsync::start<Result, ValueType>(std::forward<JobContinuation<Result, ValueType>>(func)));
+}
+
+template<typename List, typename Result, typename ValueType>
+Job<QVector<Result>, List> map(JobContinuation<Result, ValueType> &&func, int maxConcurrency, ErrorPolicy errorPolicy)
+{
+    return map<List, Result, ValueType>(KAsync::start<Result, ValueType>(std::forward<JobContinuation<Result, ValueType>>(func)),
+                                        maxConcurrency, errorPolicy);
+}
+
+template<typename List, typename Result, typename Acc, typename ValueType>
+Job<Acc, List> reduce(KAsync::Job<Result, ValueType> job, Acc init, std::function<Acc(Acc, Result)> combiner,
+                      int maxConcurrency, ErrorPolicy errorPolicy)
+{
+    using State = Private::ForEachState<List, ValueType, Result, Acc>;
+    return Private::forEachImpl<List, ValueType, Result, Acc>(job, maxConcurrency, errorPolicy,
+        [init = std::move(init), combiner = std::move(combiner)](State &state) {
+            state.output = init;
+            state.collect = [combiner](Acc &acc, quint64, Result &&result) {
+                acc = combiner(std::move(acc), std::move(result));
+            };
+        });
+}
+
+template<typename List, typename Result, typename Acc, typename ValueType>
+Job<Acc, List> reduce(JobContinuation<Result, ValueType> &&func, Acc init, std::function<Acc(Acc, Result)> combiner,
+                      int maxConcurrency, ErrorPolicy errorPolicy)
+{
+    return reduce<List, Result, Acc, ValueType>(KAsync::start<Result, ValueType>(std::forward<JobContinuation<Result, ValueType>>(func)),
+                                                std::move(init), std::move(combiner), maxConcurrency, errorPolicy);
+}
+
+namespace Private {
+
+/*
+ * Splits the values of a parallel loop into halves until a range is small
+ * enough to be processed by one task. The halves that are split off are
+ * scheduled, the task goes on with the first half itself.
+ */
+template<typename List, typename ValueType, typename Result>
+struct ParallelState
+{
+    using Output = std::conditional_t<std::is_void<Result>::value, void, QVector<Result>>;
+
+    ParallelState(List &&list, Scheduler *scheduler, const std::function<Result(const ValueType &)> &func, int grainSize,
+                  const KAsync::Future<Output> &future)
+        : values(std::move(list))
+        , scheduler(scheduler)
+        , func(func)
+        , grainSize(std::max(grainSize, 1))
+        , future(future)
+        , threadContext(currentThreadContext())
+        , remaining(static_cast<qint64>(values.size()))
+    {
+        if constexpr (!std::is_void<Result>::value) {
+            results.resize(static_cast<int>(values.size()));
+            resultData = results.data();
+        }
+    }
+
+    static void run(const QSharedPointer<ParallelState> &state, qint64 begin, qint64 end)
+    {
+        while (end - begin > state->grainSize) {
+            const qint64 middle = begin + (end - begin) / 2;
+            state->scheduler->schedule([state, middle, end]() {
+                run(state, middle, end);
+            });
+            end = middle;
+        }
+        if (!state->future.isCanceled()) {
+            for (qint64 i = begin; i < end; ++i) {
+                const auto &value = *(state->values.cbegin() + i);
+                if constexpr (std::is_void<Result>::value) {
+                    state->func(value);
+                } else {
+                    // Each index is written by one task only, the buffer was sized up front
+                    state->resultData[i] = state->func(value);
+                }
+            }
+        }
+        if (state->remaining.fetch_sub(end - begin) == end - begin) {
+            invokeInThread(state->threadContext, [state]() {
+                finish(state);
+            });
+        }
+    }
+
+    static void finish(const QSharedPointer<ParallelState> &state)
+    {
+        if (state->future.isFinished()) {
+            // Canceled
+            return;
+        }
+        if constexpr (std::is_void<Result>::value) {
+            state->future.setFinished();
+        } else {
+            state->future.setResult(std::move(state->results));
+        }
+    }
+
+    const List values;
+    Scheduler * const scheduler;
+    const std::function<Result(const ValueType &)> func;
+    const int grainSize;
+    KAsync::Future<Output> future;
+    const QPointer<QObject> threadContext;
+    std::conditional_t<std::is_void<Result>::value, std::nullptr_t, QVector<Result>> results;
+    std::conditional_t<std::is_void<Result>::value, std::nullptr_t, Result *> resultData = nullptr;
+    std::atomic<qint64> remaining;
+};
+
+template<typename List, typename ValueType, typename Result>
+Job<typename ParallelState<List, ValueType, Result>::Output, List> parallelImpl(Scheduler *scheduler,
+        const std::function<Result(const ValueType &)> &func, int grainSize)
+{
+    using State = ParallelState<List, ValueType, Result>;
+    using Output = typename State::Output;
+    Q_ASSERT(scheduler);
+    return KAsync::start<Output, List>([scheduler, func, grainSize](List values, KAsync::Future<Output> &future) {
+            auto state = QSharedPointer<State>::create(std::move(values), scheduler, func, grainSize, future);
+            if (state->remaining == 0) {
+                State::finish(state);
+                return;
+            }
+            const qint64 end = state->remaining;
+            scheduler->schedule([state, end]() {
+                State::run(state, 0, end);
+            });
+        });
+}
+
+} // namespace Private
+
+template<typename List>
+Job<void, List> parallelForEach(Scheduler *scheduler, std::function<void(const typename List::value_type &)> func,
+                                int grainSize)
+{
+    return Private::parallelImpl<List, typename List::value_type, void>(scheduler, func, grainSize);
+}
+
+template<typename List, typename Result>
+Job<QVector<Result>, List> parallelMap(Scheduler *scheduler, std::function<Result(const typename List::value_type &)> func,
+                                       int grainSize)
+{
+    return Private::parallelImpl<List, typename List::value_type, Result>(scheduler, func, grainSize);
+}
+
 template<typename Out>
 Job<Out> null()
 {
@@ -290,24 +915,91 @@ Job<Out> error(const Error &error)
         });
 }
 
-inline Job<void> doWhile(const Job<ControlFlowFlag> &body)
+namespace Private {
+
+/*
+ * Shared state of a doWhile loop.
+ *
+ * Executes the same body again from the completion of the previous iteration.
+ * Iterations that finish synchronously end up in the loop in iterate() instead
+ * of nesting, so neither the stack nor the memory grows with the number of iterations.
+ */
+struct DoWhileState
 {
-    return KAsync::start<void>([body] (KAsync::Future<void> &future) {
-        auto job = body.then<void, ControlFlowFlag>([&future, body](const KAsync::Error &error, ControlFlowFlag flag) {
+    explicit DoWhileState(const KAsync::Future<void> &future)
+        : future(future)
+    {}
+
+    static QSharedPointer<DoWhileState> create(const KAsync::Job<ControlFlowFlag> &body, const KAsync::Future<void> &future)
+    {
+        auto state = QSharedPointer<DoWhileState>::create(future);
+        // Built once for all iterations, the weak reference avoids a cycle
+        // through the job stored in the state
+        const auto weakState = state.toWeakRef();
+        state->iteration = body.then<void, ControlFlowFlag>([weakState](const KAsync::Error &error, ControlFlowFlag flag) {
+            const auto state = weakState.toStrongRef();
+            if (!state) {
+                return;
+            }
             if (error) {
-                future.setError(error);
-                future.setFinished();
+                state->future.setError(error);
+                state->self.reset();
             } else if (flag == ControlFlowFlag::Continue) {
-                doWhile(body).then<void>([&future](const KAsync::Error &error) {
-                    if (error) {
-                        future.setError(error);
-                    }
-                    future.setFinished();
-                }).exec();
+                iterate(state);
             } else {
-                future.setFinished();
+                state->future.setFinished();
+                state->self.reset();
+            }
+        });
+        // Keeps the state alive while the loop runs
+        state->self = state;
+        return state;
+    }
+
+    static void cancel(const QSharedPointer<DoWhileState> &state)
+    {
+        state->current.cancel();
+        state->self.reset();
+    }
+
+    static void iterate(const QSharedPointer<DoWhileState> &state)
+    {
+        if (state->iterating) {
+            state->again = true;
+            return;
+        }
+        state->iterating = true;
+        do {
+            state->again = false;
+            if (state->future.isCanceled()) {
+                break;
             }
-        }).exec();
+            state->current = state->iteration->exec();
+        } while (state->again);
+        state->iterating = false;
+    }
+
+    std::optional<KAsync::Job<void>> iteration;
+    KAsync::Future<void> future;
+    // The running iteration, to cancel it along with the loop
+    KAsync::Future<void> current;
+    QSharedPointer<DoWhileState> self;
+    bool iterating = false;
+    bool again = false;
+};
+
+} // namespace Private
+
+inline Job<void> doWhile(const Job<ControlFlowFlag> &body)
+{
+    return KAsync::start<void>([body] (KAsync::Future<void> &future) {
+        auto state = Private::DoWhileState::create(body, future);
+        future.onCanceled([weakState = state.toWeakRef()]() {
+            if (auto state = weakState.toStrongRef()) {
+                Private::DoWhileState::cancel(state);
+            }
+        });
+        Private::DoWhileState::iterate(state);
     });
 }
 
@@ -321,11 +1013,151 @@ inline Job<void> doWhile(const JobContinuation<ControlFlowFlag> &body)
 inline Job<void> wait(int delay)
 {
     return KAsync::start<void>([delay](KAsync::Future<void> &future) {
-        QTimer::singleShot(delay, [&future]() {
+        auto timer = new QTimer;
+        timer->setSingleShot(true);
+        QObject::connect(timer, &QTimer::timeout, [&future, timer]() {
+            timer->deleteLater();
             future.setFinished();
         });
+        future.onCanceled([timer]() {
+            timer->stop();
+            timer->deleteLater();
+        });
+        timer->start(delay);
     });
 }
+
+inline int BackoffPolicy::delay(int attempt) const
+{
+    static thread_local std::minstd_rand random{std::random_device()()};
+    const double exponential = initialDelay * std::pow(multiplier, std::max(0, attempt - 1));
+    const double capped = std::min(exponential, static_cast<double>(maxDelay));
+    const double randomized = capped * jitter * std::uniform_real_distribution<double>(0.0, 1.0)(random);
+    return static_cast<int>(capped - randomized);
+}
+
+namespace Private {
+
+/*
+ * Shared state of a retried job.
+ *
+ * Each attempt executes the same job again, started from the completion of
+ * the previous one once its delay has passed.
+ */
+template<typename Out, typename ... In>
+struct RetryState
+{
+    RetryState(const KAsync::Job<Out, In ...> &job, std::tuple<std::decay_t<In> ...> &&input, int maxAttempts,
+               const BackoffPolicy &backoff, const std::function<bool(const KAsync::Error &)> &predicate,
+               const KAsync::Future<Out> &future)
+        : job(job)
+        , input(std::move(input))
+        , maxAttempts(maxAttempts)
+        , backoff(backoff)
+        , predicate(predicate)
+        , future(future)
+    {}
+
+    static void attempt(const QSharedPointer<RetryState> &state)
+    {
+        // A delay removed from another thread still expires, see cancel()
+        if (state->future.isFinished() || state->future.isCanceled()) {
+            return;
+        }
+        state->attempts++;
+        // The job itself is executed again, its chain is only built once
+        auto current = std::apply([&state](const auto & ... input) {
+                return state->job.exec(input ...);
+            }, state->input);
+        {
+            QMutexLocker locker(&state->mutex);
+            state->current = current;
+        }
+        current.onFinished([state, current]() mutable {
+            // Canceling the retried job cancels the attempt as well
+            if (state->future.isFinished() || state->future.isCanceled()) {
+                return;
+            }
+            if (current.hasError()) {
+                failed(state, current.errors());
+            } else if constexpr (std::is_void<Out>::value) {
+                state->future.setFinished();
+            } else {
+                state->future.setResult(current.takeValue());
+            }
+        });
+    }
+
+    static void failed(const QSharedPointer<RetryState> &state, const QVector<KAsync::Error> &errors)
+    {
+        if (state->attempts >= state->maxAttempts || (state->predicate && !state->predicate(errors.first()))) {
+            state->future.setErrors(errors);
+            return;
+        }
+        const int delay = state->backoff.delay(state->attempts);
+        if (delay <= 0) {
+            attempt(state);
+            return;
+        }
+        auto pendingDelay = addDeadline(delay, [state]() {
+            attempt(state);
+        });
+        if (!pendingDelay) {
+            // No event loop to wait in, retry right away instead of never
+            attempt(state);
+            return;
+        }
+        QMutexLocker locker(&state->mutex);
+        state->pendingDelay = std::move(pendingDelay);
+    }
+
+    static void cancel(const QSharedPointer<RetryState> &state)
+    {
+        Deadline pendingDelay;
+        KAsync::Future<Out> current;
+        {
+            QMutexLocker locker(&state->mutex);
+            pendingDelay = state->pendingDelay;
+            current = state->current;
+        }
+        removeDeadline(pendingDelay);
+        current.cancel();
+    }
+
+    const KAsync::Job<Out, In ...> job;
+    const std::tuple<std::decay_t<In> ...> input;
+    const int maxAttempts;
+    const BackoffPolicy backoff;
+    const std::function<bool(const KAsync::Error &)> predicate;
+    KAsync::Future<Out> future;
+    // Guards current and pendingDelay, the retried job may be canceled from
+    // another thread
+    QMutex mutex;
+    // The running attempt, to cancel it along with the retried job
+    KAsync::Future<Out> current;
+    Deadline pendingDelay;
+    int attempts = 0;
+};
+
+} // namespace Private
+
+template<typename Out, typename ... In>
+Job<Out, In ...> Job<Out, In ...>::retry(int maxAttempts, const BackoffPolicy &backoff,
+                                         const std::function<bool(const KAsync::Error &)> &predicate) const
+{
+    Q_ASSERT(maxAttempts > 0);
+    using State = Private::RetryState<Out, In ...>;
+    return KAsync::start<Out, In ...>([job = *this, maxAttempts, backoff, predicate](In ... input, KAsync::Future<Out> &future) {
+            auto state = QSharedPointer<State>::create(job, std::make_tuple(std::decay_t<In>(std::move(input)) ...),
+                                                       maxAttempts, backoff, predicate, future);
+            future.onCanceled([weakState = state.toWeakRef()]() {
+                if (auto state = weakState.toStrongRef()) {
+                    State::cancel(state);
+                }
+            });
+            State::attempt(state);
+        });
+}
 } // namespace KAsync
 
 //@endcond
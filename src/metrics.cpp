@@ -0,0 +1,193 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "metrics.h"
+#include "execution_p.h"
+#include "future.h"
+
+#include <QHash>
+#include <QMutex>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace KAsync;
+using namespace KAsync::Private;
+
+namespace {
+
+qint64 now()
+{
+    const auto time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+int latencyBucket(qint64 nsecs)
+{
+    const quint64 usecs = static_cast<quint64>(std::max<qint64>(nsecs, 0)) / 1000;
+    int bucket = 0;
+    while (bucket < JobMetrics::HistogramBuckets - 1 && usecs >= (quint64(1) << bucket)) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+// Spreads the threads over the stripes of the counters
+int currentStripe(int stripeCount)
+{
+    static std::atomic<int> lastStripe{0};
+    thread_local const int stripe = lastStripe.fetch_add(1, std::memory_order_relaxed);
+    return stripe % stripeCount;
+}
+
+} // namespace
+
+namespace KAsync {
+namespace Private {
+
+/*
+ * The counters of a job name. Each thread updates one stripe of them, each
+ * stripe has its own cache line, so threads running the same job don't
+ * contend. Reading sums up all stripes.
+ */
+class MetricsCounters
+{
+public:
+    explicit MetricsCounters(const QString &name)
+        : mName(name)
+    {}
+
+    void started()
+    {
+        stripe().started.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void finished(qint64 nsecs, bool error)
+    {
+        auto &s = stripe();
+        s.finished.fetch_add(1, std::memory_order_relaxed);
+        if (error) {
+            s.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        s.histogram[latencyBucket(nsecs)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    JobMetrics snapshot() const
+    {
+        JobMetrics metrics;
+        metrics.name = mName;
+        metrics.latencyHistogram.fill(0, JobMetrics::HistogramBuckets);
+        quint64 started = 0;
+        for (const auto &s : mStripes) {
+            started += s.started.load(std::memory_order_relaxed);
+            metrics.executions += s.finished.load(std::memory_order_relaxed);
+            metrics.errors += s.errors.load(std::memory_order_relaxed);
+            for (int i = 0; i < JobMetrics::HistogramBuckets; ++i) {
+                metrics.latencyHistogram[i] += s.histogram[i].load(std::memory_order_relaxed);
+            }
+        }
+        metrics.inFlight = std::max<qint64>(static_cast<qint64>(started - metrics.executions), 0);
+        return metrics;
+    }
+
+private:
+    static constexpr int StripeCount = 16;
+
+    struct alignas(64) Stripe {
+        std::atomic<quint64> started{0};
+        std::atomic<quint64> finished{0};
+        std::atomic<quint64> errors{0};
+        std::atomic<quint64> histogram[JobMetrics::HistogramBuckets] = {};
+    };
+
+    Stripe &stripe()
+    {
+        return mStripes[currentStripe(StripeCount)];
+    }
+
+    const QString mName;
+    Stripe mStripes[StripeCount];
+};
+
+} // namespace Private
+} // namespace KAsync
+
+namespace {
+
+// The counters are never freed, executors keep pointers to them
+struct Registry {
+    QMutex mutex;
+    QHash<QString, MetricsCounters *> byName;
+    std::vector<std::unique_ptr<MetricsCounters>> counters;
+};
+
+Registry &registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+} // namespace
+
+qint64 JobMetrics::bucketLimit(int bucket)
+{
+    return qint64(1) << bucket;
+}
+
+QVector<JobMetrics> KAsync::jobMetrics()
+{
+    auto &r = registry();
+    QMutexLocker locker(&r.mutex);
+    QVector<JobMetrics> metrics;
+    metrics.reserve(static_cast<int>(r.counters.size()));
+    for (const auto &counters : r.counters) {
+        metrics.push_back(counters->snapshot());
+    }
+    return metrics;
+}
+
+JobMetrics KAsync::jobMetrics(const QString &name)
+{
+    auto &r = registry();
+    QMutexLocker locker(&r.mutex);
+    if (auto counters = r.byName.value(name)) {
+        return counters->snapshot();
+    }
+    JobMetrics metrics;
+    metrics.name = name;
+    metrics.latencyHistogram.fill(0, JobMetrics::HistogramBuckets);
+    return metrics;
+}
+
+MetricsCounters *KAsync::Private::metricsCounters(const QString &name)
+{
+    auto &r = registry();
+    QMutexLocker locker(&r.mutex);
+    auto &counters = r.byName[name];
+    if (!counters) {
+        r.counters.push_back(std::make_unique<MetricsCounters>(name));
+        counters = r.counters.back().get();
+    }
+    return counters;
+}
+
+void KAsync::Private::metricsBegin(Execution *execution, MetricsCounters *counters)
+{
+    auto &instrumentation = execution->instrument();
+    instrumentation.metrics = counters;
+    instrumentation.metricsStart = now();
+    counters->started();
+}
+
+void KAsync::Private::metricsEnd(Execution *execution)
+{
+    auto &instrumentation = *execution->instrumentation;
+    instrumentation.metrics->finished(now() - instrumentation.metricsStart, execution->resultBase->hasError());
+    instrumentation.metrics = nullptr;
+}
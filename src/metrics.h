@@ -0,0 +1,91 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_METRICS_H
+#define KASYNC_METRICS_H
+
+#include "kasync_export.h"
+
+#include <QString>
+#include <QVector>
+
+namespace KAsync {
+
+/**
+ * @ingroup Metrics
+ *
+ * @brief Aggregated statistics of the executions of a named job.
+ *
+ * Jobs are named with Job::name(). The statistics cover every execution of
+ * every job with that name since the process started.
+ *
+ * @see jobMetrics()
+ */
+struct KASYNC_EXPORT JobMetrics
+{
+    /// Number of buckets in latencyHistogram
+    static constexpr int HistogramBuckets = 32;
+
+    /**
+     * Returns the upper bound of bucket @p bucket of latencyHistogram, in
+     * microseconds.
+     */
+    static qint64 bucketLimit(int bucket);
+
+    QString name;
+    /// Number of finished executions, including the failed ones
+    quint64 executions = 0;
+    /// Number of executions that finished with an error or were canceled
+    quint64 errors = 0;
+    /// Number of executions that have started but not finished yet
+    qint64 inFlight = 0;
+    /**
+     * Number of finished executions by the time they took to run, from the
+     * start of the continuation to the end of the job. Bucket 0 counts the
+     * executions that took less than a microsecond, bucket @c i those that
+     * took from bucketLimit(i - 1) up to bucketLimit(i), the last bucket
+     * all longer ones.
+     */
+    QVector<quint64> latencyHistogram;
+};
+
+/**
+ * @ingroup Metrics
+ *
+ * Returns the statistics of all named jobs.
+ *
+ * The counters are updated without locking by the threads running the jobs,
+ * and only summed up when read, so naming a job costs little. Jobs running
+ * concurrently may make a snapshot slightly inconsistent, for example list
+ * an execution as finished that is still counted as in flight.
+ */
+KASYNC_EXPORT QVector<JobMetrics> jobMetrics();
+
+/**
+ * @ingroup Metrics
+ *
+ * Returns the statistics of the jobs named @p name, which are empty if no
+ * such job was created yet.
+ */
+KASYNC_EXPORT JobMetrics jobMetrics(const QString &name);
+
+//@cond PRIVATE
+namespace Private {
+
+struct Execution;
+class MetricsCounters;
+
+// Returns the counters of the jobs named @p name, created on first use
+KASYNC_EXPORT MetricsCounters *metricsCounters(const QString &name);
+KASYNC_EXPORT void metricsBegin(Execution *execution, MetricsCounters *counters);
+KASYNC_EXPORT void metricsEnd(Execution *execution);
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif // KASYNC_METRICS_H
@@ -0,0 +1,504 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "scheduler.h"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QMutex>
+#include <QObject>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QTimer>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace KAsync;
+
+std::atomic<bool> KAsync::Private::batchCompletions{false};
+
+namespace {
+
+class SchedulerTask : public QRunnable
+{
+public:
+    explicit SchedulerTask(std::function<void()> &&task)
+        : mTask(std::move(task))
+    {}
+
+    void run() override
+    {
+        mTask();
+    }
+
+private:
+    std::function<void()> mTask;
+};
+
+class InvokeEvent : public QEvent
+{
+public:
+    explicit InvokeEvent(std::function<void()> &&task)
+        : QEvent(eventType())
+        , task(std::move(task))
+    {}
+
+    static QEvent::Type eventType()
+    {
+        static const auto type = static_cast<QEvent::Type>(QEvent::registerEventType());
+        return type;
+    }
+
+    std::function<void()> task;
+};
+
+class DrainEvent : public QEvent
+{
+public:
+    DrainEvent()
+        : QEvent(eventType())
+    {}
+
+    static QEvent::Type eventType()
+    {
+        static const auto type = static_cast<QEvent::Type>(QEvent::registerEventType());
+        return type;
+    }
+};
+
+class ThreadContext : public QObject
+{
+public:
+    // Adds @p task to the run queue, posting a drain event only if none is pending
+    void enqueue(std::function<void()> &&task)
+    {
+        {
+            QMutexLocker locker(&mMutex);
+            mQueue.push_back(std::move(task));
+            if (mDrainPosted) {
+                return;
+            }
+            mDrainPosted = true;
+        }
+        QCoreApplication::postEvent(this, new DrainEvent);
+    }
+
+    bool event(QEvent *event) override
+    {
+        if (event->type() == InvokeEvent::eventType()) {
+            static_cast<InvokeEvent *>(event)->task();
+            return true;
+        }
+        if (event->type() == DrainEvent::eventType()) {
+            drain();
+            return true;
+        }
+        return QObject::event(event);
+    }
+
+private:
+    void drain()
+    {
+        // Tasks queued by the batch go into the next one, which keeps the stack
+        // flat and lets nested event loops of a task drain the queue too
+        std::vector<std::function<void()>> batch;
+        {
+            QMutexLocker locker(&mMutex);
+            batch.swap(mQueue);
+            mDrainPosted = false;
+        }
+        for (auto &task : batch) {
+            task();
+        }
+    }
+
+    QMutex mMutex;
+    std::vector<std::function<void()>> mQueue;
+    bool mDrainPosted = false;
+};
+
+// Deletes the context of a thread once the thread finishes
+QThreadStorage<ThreadContext *> sThreadContexts;
+
+class RemoveDeadlineEvent : public QEvent
+{
+public:
+    explicit RemoveDeadlineEvent(const std::pair<qint64, quint64> &key)
+        : QEvent(eventType())
+        , key(key)
+    {}
+
+    static QEvent::Type eventType()
+    {
+        static const auto type = static_cast<QEvent::Type>(QEvent::registerEventType());
+        return type;
+    }
+
+    const std::pair<qint64, quint64> key;
+};
+
+} // namespace
+
+namespace KAsync {
+namespace Private {
+
+// Lets other threads post removals to the DeadlineTimer of a thread, for as
+// long as the timer exists
+class DeadlineOwner
+{
+public:
+    QMutex mutex;
+    QObject *timer = nullptr;
+};
+
+} // namespace Private
+} // namespace KAsync
+
+namespace {
+
+// Runs the expired deadlines of a thread, with the timer always set to the
+// earliest one
+class DeadlineTimer : public QObject
+{
+public:
+    using Key = std::pair<qint64, quint64>;
+
+    DeadlineTimer()
+        : mOwner(std::make_shared<Private::DeadlineOwner>())
+    {
+        mOwner->timer = this;
+        mClock.start();
+        mTimer.setSingleShot(true);
+        QObject::connect(&mTimer, &QTimer::timeout, this, [this]() {
+            expire();
+        });
+    }
+
+    ~DeadlineTimer() override
+    {
+        QMutexLocker locker(&mOwner->mutex);
+        mOwner->timer = nullptr;
+    }
+
+    Private::Deadline add(int msecs, std::function<void()> &&callback)
+    {
+        static std::atomic<quint64> lastId{0};
+        const Key key{mClock.elapsed() + msecs, ++lastId};
+        mDeadlines.emplace(key, std::move(callback));
+        if (mDeadlines.begin()->first == key) {
+            restart();
+        }
+        return Private::Deadline{key.first, key.second, mOwner};
+    }
+
+    void remove(const Key &key)
+    {
+        // The timer is not restarted, expiring early just finds nothing to do
+        mDeadlines.erase(key);
+    }
+
+    bool event(QEvent *event) override
+    {
+        if (event->type() == RemoveDeadlineEvent::eventType()) {
+            remove(static_cast<RemoveDeadlineEvent *>(event)->key);
+            return true;
+        }
+        return QObject::event(event);
+    }
+
+private:
+    void expire()
+    {
+        const qint64 now = mClock.elapsed();
+        while (!mDeadlines.empty() && mDeadlines.begin()->first.first <= now) {
+            // The callback may add or remove deadlines
+            auto callback = std::move(mDeadlines.begin()->second);
+            mDeadlines.erase(mDeadlines.begin());
+            callback();
+        }
+        restart();
+    }
+
+    void restart()
+    {
+        if (mDeadlines.empty()) {
+            mTimer.stop();
+        } else {
+            mTimer.start(static_cast<int>(std::max<qint64>(0, mDeadlines.begin()->first.first - mClock.elapsed())));
+        }
+    }
+
+    const std::shared_ptr<Private::DeadlineOwner> mOwner;
+    QElapsedTimer mClock;
+    QTimer mTimer;
+    std::map<Key, std::function<void()>> mDeadlines;
+};
+
+QThreadStorage<DeadlineTimer *> sDeadlineTimers;
+
+// Whether events posted to the current thread get processed. Every started
+// QThread has an event dispatcher, including the workers of a QThreadPool, but
+// only a running event loop processes its events. The main thread counts as
+// soon as the application exists, its loop is often started after the first jobs.
+bool hasEventLoop()
+{
+    if (!QAbstractEventDispatcher::instance()) {
+        return false;
+    }
+    QThread *thread = QThread::currentThread();
+    if (thread->loopLevel() > 0) {
+        return true;
+    }
+    const auto app = QCoreApplication::instance();
+    return app && app->thread() == thread;
+}
+
+} // namespace
+
+Scheduler::~Scheduler() = default;
+
+ThreadPoolScheduler::ThreadPoolScheduler(QThreadPool *pool)
+    : mPool(pool ? pool : QThreadPool::globalInstance())
+{
+}
+
+ThreadPoolScheduler::~ThreadPoolScheduler() = default;
+
+void ThreadPoolScheduler::schedule(std::function<void()> &&task)
+{
+    mPool->start(new SchedulerTask(std::move(task)));
+}
+
+class WorkStealingScheduler::Private
+{
+public:
+    struct Worker {
+        QMutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    explicit Private(int threadCount)
+    {
+        workers.reserve(threadCount);
+        for (int i = 0; i < threadCount; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        // Started once all deques exist, the workers steal from each other
+        for (int i = 0; i < threadCount; ++i) {
+            workers[i]->thread = std::thread([this, i]() {
+                run(i);
+            });
+        }
+    }
+
+    ~Private()
+    {
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    void schedule(std::function<void()> &&task)
+    {
+        if (tCurrent.scheduler == this) {
+            auto &worker = *workers[tCurrent.index];
+            QMutexLocker locker(&worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        } else {
+            std::lock_guard<std::mutex> locker(mutex);
+            shared.push_back(std::move(task));
+        }
+        // Counted only once the task can be found, so waking up finds it
+        ++pending;
+        if (sleeping.load() > 0) {
+            {
+                std::lock_guard<std::mutex> locker(mutex);
+            }
+            wake.notify_one();
+        }
+    }
+
+    void run(int index)
+    {
+        tCurrent = {this, index};
+        std::function<void()> task;
+        while (true) {
+            if (take(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> locker(mutex);
+            ++sleeping;
+            wake.wait(locker, [this]() {
+                return stopping || pending.load() > 0;
+            });
+            --sleeping;
+            if (stopping && pending.load() <= 0) {
+                return;
+            }
+        }
+    }
+
+    // The newest own task, then the shared ones, then the oldest task of another worker
+    bool take(int index, std::function<void()> &task)
+    {
+        {
+            auto &worker = *workers[index];
+            QMutexLocker locker(&worker.mutex);
+            if (!worker.tasks.empty()) {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                --pending;
+                return true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> locker(mutex);
+            if (!shared.empty()) {
+                task = std::move(shared.front());
+                shared.pop_front();
+                --pending;
+                return true;
+            }
+        }
+        const int count = static_cast<int>(workers.size());
+        for (int i = 1; i < count; ++i) {
+            auto &victim = *workers[(index + i) % count];
+            QMutexLocker locker(&victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --pending;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct Current {
+        Private *scheduler;
+        int index;
+    };
+    static thread_local Current tCurrent;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    // Protects shared and stopping, and pairs with wake
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> shared;
+    // Tasks that have been scheduled but not taken yet
+    std::atomic<int> pending{0};
+    std::atomic<int> sleeping{0};
+    bool stopping = false;
+};
+
+thread_local WorkStealingScheduler::Private::Current WorkStealingScheduler::Private::tCurrent{nullptr, 0};
+
+WorkStealingScheduler::WorkStealingScheduler(int threadCount)
+    : d(std::make_unique<Private>(threadCount > 0 ? threadCount : std::max(QThread::idealThreadCount(), 1)))
+{
+}
+
+WorkStealingScheduler::~WorkStealingScheduler() = default;
+
+int WorkStealingScheduler::threadCount() const
+{
+    return static_cast<int>(d->workers.size());
+}
+
+void WorkStealingScheduler::schedule(std::function<void()> &&task)
+{
+    d->schedule(std::move(task));
+}
+
+void KAsync::setCompletionBatching(bool enabled)
+{
+    Private::batchCompletions.store(enabled, std::memory_order_relaxed);
+}
+
+QObject *Private::currentThreadContext()
+{
+    if (!hasEventLoop()) {
+        return nullptr;
+    }
+    if (!sThreadContexts.hasLocalData()) {
+        sThreadContexts.setLocalData(new ThreadContext);
+    }
+    return sThreadContexts.localData();
+}
+
+void Private::invokeInThread(QObject *threadContext, std::function<void()> &&task)
+{
+    if (!threadContext) {
+        task();
+        return;
+    }
+    if (Private::batchCompletions.load(std::memory_order_relaxed)) {
+        static_cast<ThreadContext *>(threadContext)->enqueue(std::move(task));
+        return;
+    }
+    QCoreApplication::postEvent(threadContext, new InvokeEvent(std::move(task)));
+}
+
+void Private::enqueueCompletion(std::function<void()> &&task)
+{
+    auto threadContext = static_cast<ThreadContext *>(currentThreadContext());
+    if (!threadContext) {
+        task();
+        return;
+    }
+    threadContext->enqueue(std::move(task));
+}
+
+Private::Deadline Private::addDeadline(int msecs, std::function<void()> &&callback)
+{
+    if (!hasEventLoop()) {
+        return {};
+    }
+    if (!sDeadlineTimers.hasLocalData()) {
+        sDeadlineTimers.setLocalData(new DeadlineTimer);
+    }
+    return sDeadlineTimers.localData()->add(msecs, std::move(callback));
+}
+
+void Private::removeDeadline(const Deadline &deadline)
+{
+    if (!deadline) {
+        return;
+    }
+    const DeadlineTimer::Key key{deadline.time, deadline.id};
+    // Keeps the timer from being deleted with its thread meanwhile
+    QMutexLocker locker(&deadline.owner->mutex);
+    auto timer = static_cast<DeadlineTimer *>(deadline.owner->timer);
+    if (!timer) {
+        return;
+    }
+    if (timer->thread() != QThread::currentThread()) {
+        QCoreApplication::postEvent(timer, new RemoveDeadlineEvent(key));
+        return;
+    }
+    // Only deleted by this thread, and dropping the callback may remove others
+    locker.unlock();
+    timer->remove(key);
+}
@@ -0,0 +1,208 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_SCHEDULER_H
+#define KASYNC_SCHEDULER_H
+
+#include "kasync_export.h"
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+
+class QObject;
+class QThreadPool;
+
+namespace KAsync {
+
+/**
+ * @ingroup Scheduler
+ *
+ * @brief Interface for running the work of a job somewhere else.
+ *
+ * A Scheduler is assigned to a job with Job::on(). Synchronous continuations
+ * of such a job are not executed on the thread that finished the previous step,
+ * but handed over to the scheduler instead. Once the continuation has returned,
+ * the result is delivered back to the thread that started the step, so the rest
+ * of the chain continues to run there.
+ *
+ * The scheduler must outlive all executions that use it.
+ *
+ * @see ThreadPoolScheduler
+ */
+class KASYNC_EXPORT Scheduler
+{
+public:
+    virtual ~Scheduler();
+
+    /**
+     * Executes @p task at some point. This method can be called from any thread
+     * and the task may run on any thread.
+     */
+    virtual void schedule(std::function<void()> &&task) = 0;
+};
+
+/**
+ * @ingroup Scheduler
+ *
+ * @brief A Scheduler that runs the work on a QThreadPool.
+ *
+ * @code
+ * KAsync::ThreadPoolScheduler pool;
+ * auto job = KAsync::start<QByteArray>(&pool, [data]() {
+ *         return compress(data); // runs on a worker thread
+ *     })
+ *     .then([](const QByteArray &compressed) {
+ *         // back on the thread that called exec()
+ *     });
+ * @endcode
+ */
+class KASYNC_EXPORT ThreadPoolScheduler : public Scheduler
+{
+public:
+    /**
+     * Creates a scheduler for @p pool, or for QThreadPool::globalInstance()
+     * if no pool is given. The pool is not owned by the scheduler.
+     */
+    explicit ThreadPoolScheduler(QThreadPool *pool = nullptr);
+    ~ThreadPoolScheduler() override;
+
+    void schedule(std::function<void()> &&task) override;
+
+private:
+    QThreadPool * const mPool;
+};
+
+/**
+ * @ingroup Scheduler
+ *
+ * @brief A Scheduler for CPU bound work of uneven size, with a deque per worker.
+ *
+ * Each worker thread keeps the tasks it schedules itself in its own deque and
+ * runs the newest of them first. Workers that run out of tasks take the oldest
+ * task of another worker, so work that turns out to be bigger than expected is
+ * spread over the idle workers instead of leaving them waiting for the slowest
+ * one. Tasks scheduled from other threads are shared by all workers.
+ *
+ * This works best with tasks that split their work and schedule the parts,
+ * as parallelForEach() and parallelMap() do.
+ *
+ * @code
+ * KAsync::WorkStealingScheduler scheduler;
+ * auto job = fetchMessages(folder)
+ *     .then(KAsync::parallelMap<QVector<Message>, Terms>(&scheduler, [](const Message &message) {
+ *         return parseTerms(message.body());
+ *     }));
+ * @endcode
+ *
+ * Destroying the scheduler waits until all scheduled tasks have run.
+ */
+class KASYNC_EXPORT WorkStealingScheduler : public Scheduler
+{
+public:
+    /**
+     * Creates a scheduler with @p threadCount worker threads, by default as
+     * many as there are cores.
+     */
+    explicit WorkStealingScheduler(int threadCount = 0);
+    ~WorkStealingScheduler() override;
+
+    int threadCount() const;
+
+    void schedule(std::function<void()> &&task) override;
+
+private:
+    class Private;
+    std::unique_ptr<Private> d;
+};
+
+/**
+ * @ingroup Scheduler
+ *
+ * Enables or disables batching of completions, which is disabled by default.
+ *
+ * Normally the next step of a chain starts right away, in the same call stack,
+ * when the previous step finishes, and results of steps run on a Scheduler are
+ * delivered back with one event each. With batching, the steps that become
+ * ready are put in a run queue of the thread instead, and a single posted
+ * event runs all steps queued until then. Steps queued while the batch runs
+ * go into the next batch.
+ *
+ * This keeps the stack flat when many small jobs finish at once, for example
+ * in a forEach() over thousands of values, and saves an event per result of
+ * a Scheduler. In turn a chain of synchronous steps no longer finishes within
+ * exec(), and each step waits for the next batch of the event loop. Threads
+ * that run no event loop, like the workers of a QThreadPool, are not
+ * affected even though they have an event dispatcher, their steps still start
+ * right away.
+ */
+KASYNC_EXPORT void setCompletionBatching(bool enabled);
+
+//@cond PRIVATE
+namespace Private {
+
+/**
+ * Returns an object living in the current thread that can be used to get back
+ * into the thread with invokeInThread(), or nullptr if the current thread has
+ * no running event loop, like the workers of a QThreadPool.
+ */
+KASYNC_EXPORT QObject *currentThreadContext();
+
+/**
+ * Queues @p task to be run by the event loop of the thread @p threadContext
+ * belongs to. If @p threadContext is null the task is run immediately.
+ */
+KASYNC_EXPORT void invokeInThread(QObject *threadContext, std::function<void()> &&task);
+
+// Whether completions are batched, see setCompletionBatching()
+KASYNC_EXPORT extern std::atomic<bool> batchCompletions;
+
+/**
+ * Adds @p task to the run queue of the current thread, which is drained by a
+ * single posted event. If the current thread runs no event loop the task is
+ * run immediately.
+ */
+KASYNC_EXPORT void enqueueCompletion(std::function<void()> &&task);
+
+// The deadlines of a thread, see addDeadline()
+class DeadlineOwner;
+
+// Identifies a deadline registered with addDeadline()
+struct Deadline {
+    qint64 time = 0;
+    // 0 if no deadline was registered
+    quint64 id = 0;
+    std::shared_ptr<DeadlineOwner> owner;
+
+    explicit operator bool() const
+    {
+        return id != 0;
+    }
+};
+
+/**
+ * Invokes @p callback from the event loop of the current thread once @p msecs
+ * milliseconds have passed. All deadlines of a thread share a single timer,
+ * so registering many of them is cheap. Nothing happens if the current thread
+ * runs no event loop, the returned deadline is null then.
+ */
+KASYNC_EXPORT Deadline addDeadline(int msecs, std::function<void()> &&callback);
+
+/**
+ * Drops a deadline that has not expired yet. Called from another thread than
+ * the one that registered the deadline, the removal is posted to that thread.
+ */
+KASYNC_EXPORT void removeDeadline(const Deadline &deadline);
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif // KASYNC_SCHEDULER_H
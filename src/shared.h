@@ -0,0 +1,270 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_SHARED_H
+#define KASYNC_SHARED_H
+
+#include "async.h"
+
+#include <QHash>
+#include <QMutex>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace KAsync {
+
+//@cond PRIVATE
+namespace Private {
+
+/*
+ * The executions of a SharedJobs by key. The first exec of a key runs the
+ * job, the futures of all execs of the key while it is running wait for its
+ * result. With a ttl the finished execution is kept and answers the following
+ * execs until it expires.
+ */
+template<typename Key, typename T>
+class SharedState
+{
+public:
+    struct Entry {
+        // Set once the job has been executed
+        std::optional<KAsync::Future<T>> source;
+        QHash<quint64, KAsync::Future<T>> waiters;
+        qint64 expires = 0;
+        bool finished = false;
+        bool abandoned = false;
+    };
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    explicit SharedState(int ttl)
+        : ttl(ttl)
+    {}
+
+    static void exec(const std::shared_ptr<SharedState> &state, const Key &key, const KAsync::Job<T> &job,
+                     KAsync::Future<T> &future)
+    {
+        EntryPtr entry;
+        bool leader = false;
+        quint64 id = 0;
+        {
+            QMutexLocker locker(&state->mutex);
+            entry = state->entries.value(key);
+            if (entry && entry->finished && now() >= entry->expires) {
+                state->entries.remove(key);
+                entry.reset();
+            }
+            if (!entry) {
+                entry = std::make_shared<Entry>();
+                state->entries.insert(key, entry);
+                leader = true;
+            }
+            if (!entry->finished) {
+                id = ++state->lastWaiter;
+                entry->waiters.insert(id, future);
+            }
+        }
+
+        if (entry->finished) {
+            // The source doesn't change anymore once finished
+            deliver(*entry->source, future);
+            return;
+        }
+
+        future.onCanceled([weakState = std::weak_ptr<SharedState>(state), weakEntry = std::weak_ptr<Entry>(entry), key, id]() {
+            const auto state = weakState.lock();
+            const auto entry = weakEntry.lock();
+            if (state && entry) {
+                state->abandon(key, entry, id);
+            }
+        });
+
+        if (!leader) {
+            return;
+        }
+        auto source = job.exec();
+        bool abandoned;
+        {
+            QMutexLocker locker(&state->mutex);
+            entry->source = source;
+            abandoned = entry->abandoned;
+        }
+        if (abandoned) {
+            source.cancel();
+            return;
+        }
+        source.onFinished([state, key, entry]() {
+            state->finish(key, entry);
+        });
+    }
+
+    void finish(const Key &key, const EntryPtr &entry)
+    {
+        QHash<quint64, KAsync::Future<T>> waiters;
+        {
+            QMutexLocker locker(&mutex);
+            waiters.swap(entry->waiters);
+            entry->finished = true;
+            if (ttl > 0 && !entry->source->hasError()) {
+                entry->expires = now() + ttl;
+            } else if (entries.value(key) == entry) {
+                entries.remove(key);
+            }
+        }
+        for (auto &waiter : waiters) {
+            deliver(*entry->source, waiter);
+        }
+    }
+
+    // Cancels the job once all execs waiting for it have been canceled
+    void abandon(const Key &key, const EntryPtr &entry, quint64 id)
+    {
+        std::optional<KAsync::Future<T>> source;
+        {
+            QMutexLocker locker(&mutex);
+            if (!entry->waiters.remove(id) || !entry->waiters.isEmpty() || entry->finished) {
+                return;
+            }
+            entry->abandoned = true;
+            source = entry->source;
+            if (entries.value(key) == entry) {
+                entries.remove(key);
+            }
+        }
+        if (source) {
+            source->cancel();
+        }
+    }
+
+    static void deliver(KAsync::Future<T> &source, KAsync::Future<T> &future)
+    {
+        if (source.hasError()) {
+            future.setErrors(source.errors());
+        } else if constexpr (std::is_void<T>::value) {
+            future.setFinished();
+        } else {
+            future.setResult(source.value());
+        }
+    }
+
+    static qint64 now()
+    {
+        const auto time = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+    }
+
+    QMutex mutex;
+    const int ttl;
+    QHash<Key, EntryPtr> entries;
+    quint64 lastWaiter = 0;
+};
+
+} // namespace Private
+//@endcond
+
+/**
+ * @ingroup Shared
+ *
+ * @brief Deduplicates concurrent executions of identical jobs.
+ *
+ * SharedJobs hands out jobs by key. While a job for a key is running, the
+ * jobs for the same key executed in the meantime don't run themselves, they
+ * wait for the running one and finish with its result or errors. This saves
+ * repeated work when several callers ask for the same data at once, for
+ * example the metadata of a folder during a sync.
+ *
+ * @code
+ * KAsync::SharedJobs<FolderInfo> folderInfo;
+ *
+ * KAsync::Job<FolderInfo> fetchFolderInfo(const QString &folder)
+ * {
+ *     return folderInfo.job(folder, KAsync::start<FolderInfo>([folder]() {
+ *         return requestFolderInfo(folder);
+ *     }));
+ * }
+ * @endcode
+ *
+ * With a @c ttl the results are also kept after the job has finished, and
+ * returned by the jobs executed for the key until the ttl has passed. Errors
+ * are never kept, the next execution runs the job again. Expired results are
+ * only dropped when their key is used again or with invalidate() and clear().
+ *
+ * Canceling one of the waiting executions only detaches it, the job itself is
+ * canceled once all executions waiting for it have been canceled.
+ *
+ * SharedJobs is an implicitly shared handle, copies share the running and
+ * kept jobs. The result type must be copyable, each execution gets a copy.
+ */
+template<typename T, typename Key = QString>
+class SharedJobs
+{
+public:
+    /**
+     * Creates an empty set of shared jobs that keep their results for @p ttl
+     * milliseconds, or not at all with the default of 0.
+     */
+    explicit SharedJobs(int ttl = 0)
+        : d(std::make_shared<Private::SharedState<Key, T>>(ttl))
+    {}
+
+    /**
+     * Returns a job that runs @p job, unless a job for @p key is already
+     * running or its result is kept, in which case it finishes with that
+     * result instead.
+     */
+    Job<T> job(const Key &key, const Job<T> &job) const
+    {
+        return KAsync::start<T>([state = d, key, job](KAsync::Future<T> &future) {
+            Private::SharedState<Key, T>::exec(state, key, job, future);
+        });
+    }
+
+    /**
+     * Drops the kept result of @p key. A job for the key that is still
+     * running is not affected, but the following execs start a new one.
+     */
+    void invalidate(const Key &key) const
+    {
+        QMutexLocker locker(&d->mutex);
+        d->entries.remove(key);
+    }
+
+    /**
+     * Drops all kept results, see invalidate().
+     */
+    void clear() const
+    {
+        QMutexLocker locker(&d->mutex);
+        d->entries.clear();
+    }
+
+private:
+    std::shared_ptr<Private::SharedState<Key, T>> d;
+};
+
+/**
+ * @ingroup Shared
+ *
+ * Returns a job that runs @p job once for all its executions that overlap,
+ * and optionally keeps the result for @p ttl milliseconds.
+ *
+ * This is SharedJobs with a single key, see there for the details.
+ *
+ * @code
+ * const auto settings = KAsync::shared(loadSettings(), 60000);
+ * @endcode
+ */
+template<typename T>
+Job<T> shared(const Job<T> &job, int ttl = 0)
+{
+    return SharedJobs<T, int>(ttl).job(0, job);
+}
+
+} // namespace KAsync
+
+#endif // KASYNC_SHARED_H
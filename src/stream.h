@@ -0,0 +1,353 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_STREAM_H
+#define KASYNC_STREAM_H
+
+#include "async.h"
+
+#include <QMutex>
+#include <QSharedPointer>
+
+#include <algorithm>
+#include <deque>
+#include <optional>
+#include <utility>
+
+namespace KAsync {
+
+//@cond PRIVATE
+namespace Private {
+
+/*
+ * The buffer shared by the producer and the consumer of a Stream. Values
+ * beyond the capacity are still buffered, but the write that added them only
+ * finishes once the consumer has made room, which pauses a producer that
+ * waits for its writes.
+ */
+template<typename T>
+class StreamState
+{
+public:
+    explicit StreamState(int capacity)
+        : capacity(std::max(capacity, 1))
+    {}
+
+    void write(T &&value, KAsync::Future<void> &future)
+    {
+        std::optional<KAsync::Future<std::optional<T>>> reader;
+        {
+            QMutexLocker locker(&mutex);
+            if (closed || canceled) {
+                locker.unlock();
+                future.setError(Error(CanceledError, QStringLiteral("Stream is closed")));
+                return;
+            }
+            if (pendingRead) {
+                reader.swap(pendingRead);
+            } else {
+                buffer.push_back(std::move(value));
+                if (static_cast<int>(buffer.size()) > capacity) {
+                    blockedWriters.push_back(future);
+                    return;
+                }
+            }
+        }
+        if (reader) {
+            reader->setResult(std::optional<T>(std::move(value)));
+        }
+        future.setFinished();
+    }
+
+    void read(KAsync::Future<std::optional<T>> &future)
+    {
+        std::optional<T> value;
+        std::optional<KAsync::Future<void>> writer;
+        Error error;
+        {
+            QMutexLocker locker(&mutex);
+            if (!buffer.empty()) {
+                value = std::move(buffer.front());
+                buffer.pop_front();
+                if (!blockedWriters.empty()) {
+                    writer = std::move(blockedWriters.front());
+                    blockedWriters.pop_front();
+                }
+            } else if (canceled) {
+                error = Error(CanceledError, QStringLiteral("Stream is canceled"));
+            } else if (closed) {
+                error = closeError;
+            } else {
+                pendingRead = future;
+                return;
+            }
+        }
+        if (writer) {
+            writer->setFinished();
+        }
+        if (error) {
+            future.setError(error);
+        } else {
+            future.setResult(std::move(value));
+        }
+    }
+
+    void close(const Error &error)
+    {
+        std::optional<KAsync::Future<std::optional<T>>> reader;
+        {
+            QMutexLocker locker(&mutex);
+            if (closed || canceled) {
+                return;
+            }
+            closed = true;
+            closeError = error;
+            reader.swap(pendingRead);
+        }
+        if (reader && error) {
+            reader->setError(error);
+        } else if (reader) {
+            reader->setResult(std::nullopt);
+        }
+    }
+
+    void cancel()
+    {
+        std::deque<KAsync::Future<void>> writers;
+        std::optional<KAsync::Future<std::optional<T>>> reader;
+        {
+            QMutexLocker locker(&mutex);
+            if (canceled) {
+                return;
+            }
+            canceled = true;
+            buffer.clear();
+            writers.swap(blockedWriters);
+            reader.swap(pendingRead);
+        }
+        const Error error(CanceledError, QStringLiteral("Stream is canceled"));
+        for (auto &writer : writers) {
+            writer.setError(error);
+        }
+        if (reader) {
+            reader->setError(error);
+        }
+    }
+
+    QMutex mutex;
+    const int capacity;
+    std::deque<T> buffer;
+    // One write per buffered value beyond the capacity
+    std::deque<KAsync::Future<void>> blockedWriters;
+    std::optional<KAsync::Future<std::optional<T>>> pendingRead;
+    Error closeError;
+    bool closed = false;
+    bool canceled = false;
+};
+
+} // namespace Private
+//@endcond
+
+/**
+ * @ingroup Stream
+ *
+ * @brief A bounded sequence of values delivered while they are produced.
+ *
+ * A Stream lets a job pass on results one by one, for example the pages of a
+ * paged fetch, instead of collecting them all in a list before the next job
+ * can start. A job returning a Stream&lt;T&gt; finishes right away, the values
+ * follow through the stream.
+ *
+ * The producer adds values with write() and ends the stream with close().
+ * The consumer takes them with read(), or more conveniently by passing the
+ * stream on to consume() or transform(). At most capacity() values are
+ * buffered. Once the buffer is full, the jobs returned by write() only finish
+ * after the consumer has taken a value, so a producer that waits for its
+ * writes is paused and memory use stays bounded.
+ *
+ * @code
+ * KAsync::Job<KAsync::Stream<Message>> fetchMessages(Folder folder)
+ * {
+ *     return KAsync::start<KAsync::Stream<Message>>([folder]() {
+ *         KAsync::Stream<Message> stream(32);
+ *         KAsync::doWhile([folder, stream]() {
+ *             return fetchNextPage(folder).then([stream](const Page &page) {
+ *                 ...
+ *                 return stream.write(page.message()).then([]() { return KAsync::Continue; });
+ *             });
+ *         }).then([stream](const KAsync::Error &error) {
+ *             stream.close(error);
+ *         }).exec();
+ *         return stream;
+ *     });
+ * }
+ *
+ * auto job = fetchMessages(inbox).then(KAsync::consume<Message>(indexMessage));
+ * @endcode
+ *
+ * Stream is an implicitly shared handle, copies refer to the same stream.
+ * There must be only one consumer at a time. The values must be copyable.
+ */
+template<typename T>
+class Stream
+{
+public:
+    using value_type = T;
+
+    /**
+     * Creates a stream buffering up to @p capacity values.
+     */
+    explicit Stream(int capacity = 16)
+        : d(QSharedPointer<Private::StreamState<T>>::create(capacity))
+    {}
+
+    int capacity() const
+    {
+        return d->capacity;
+    }
+
+    /**
+     * Returns a job that adds @p value to the stream. The job finishes once
+     * the value fits in the buffer, and fails with a CanceledError if the
+     * stream is closed or the consumer canceled it.
+     */
+    Job<void> write(const T &value) const
+    {
+        return KAsync::start<void>([state = d, value](KAsync::Future<void> &future) {
+            state->write(T(value), future);
+        });
+    }
+
+    /**
+     * Ends the stream. The consumer still receives the buffered values, and
+     * then @p error if one is given.
+     */
+    void close(const Error &error = Error()) const
+    {
+        d->close(error);
+    }
+
+    /**
+     * Returns a job that takes the next value from the stream. The job
+     * returns an empty optional once the stream is closed and all values
+     * have been read, or fails with the error the stream was closed with.
+     */
+    Job<std::optional<T>> read() const
+    {
+        return KAsync::start<std::optional<T>>([state = d](KAsync::Future<std::optional<T>> &future) {
+            state->read(future);
+        });
+    }
+
+    /**
+     * Drops the buffered values and makes all pending and following writes
+     * fail. Used by the consumer to stop the producer.
+     */
+    void cancel() const
+    {
+        d->cancel();
+    }
+
+private:
+    QSharedPointer<Private::StreamState<T>> d;
+};
+
+/**
+ * @ingroup Stream
+ *
+ * Returns a job that runs @p job for each value of a stream, one after the
+ * other, as the values arrive.
+ *
+ * The returned job finishes once the stream is closed and all values have
+ * been processed. If @p job fails, the stream is canceled, which stops the
+ * producer, and the returned job fails with that error.
+ *
+ * @see serialForEach()
+ */
+template<typename T>
+Job<void, Stream<T>> consume(KAsync::Job<void, T> job)
+{
+    return KAsync::start<void, Stream<T>>([job](Stream<T> stream) {
+        return KAsync::doWhile([job, stream]() {
+            return stream.read().then([job](const KAsync::Error &error, std::optional<T> value) {
+                if (error) {
+                    return KAsync::error<ControlFlowFlag>(error);
+                }
+                if (!value) {
+                    return KAsync::value(KAsync::Break);
+                }
+                return KAsync::value<T>(std::move(*value)).then(job).then([]() {
+                    return KAsync::Continue;
+                });
+            });
+        }).then([stream](const KAsync::Error &error) {
+            if (error) {
+                stream.cancel();
+                return KAsync::error<void>(error);
+            }
+            return KAsync::null<void>();
+        });
+    });
+}
+
+/**
+ * @ingroup Stream
+ *
+ * Shorthand that takes a continuation.
+ *
+ * @see consume(KAsync::Job<void, T>)
+ */
+template<typename T>
+Job<void, Stream<T>> consume(JobContinuation<void, T> &&func)
+{
+    return consume<T>(KAsync::start<void, T>(std::forward<JobContinuation<void, T>>(func)));
+}
+
+/**
+ * @ingroup Stream
+ *
+ * Returns a job that runs @p job for each value of a stream and passes the
+ * results on in a new stream with the given @p capacity, so processing stages
+ * can be chained without collecting the values.
+ *
+ * The values are processed one after the other. Processing pauses while the
+ * new stream is full. If @p job fails, the input stream is canceled and the
+ * new stream is closed with the error. If the consumer of the new stream
+ * cancels it, the input stream is canceled too.
+ */
+template<typename T, typename Result>
+Job<Stream<Result>, Stream<T>> transform(KAsync::Job<Result, T> job, int capacity = 16)
+{
+    return KAsync::start<Stream<Result>, Stream<T>>([job, capacity](Stream<T> input) {
+        Stream<Result> output(capacity);
+        auto process = KAsync::start<void, T>([job, output](T value) {
+            return KAsync::value<T>(std::move(value)).then(job).then([output](Result result) {
+                return output.write(result);
+            });
+        });
+        consume<T>(process).then([output](const KAsync::Error &error) {
+            output.close(error);
+        }).exec(input);
+        return output;
+    });
+}
+
+/**
+ * @ingroup Stream
+ *
+ * Shorthand that takes a continuation.
+ *
+ * @see transform(KAsync::Job<Result, T>, int)
+ */
+template<typename T, typename Result>
+Job<Stream<Result>, Stream<T>> transform(JobContinuation<Result, T> &&func, int capacity = 16)
+{
+    return transform<T, Result>(KAsync::start<Result, T>(std::forward<JobContinuation<Result, T>>(func)), capacity);
+}
+
+} // namespace KAsync
+
+#endif // KASYNC_STREAM_H
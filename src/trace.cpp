@@ -0,0 +1,240 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "trace.h"
+#include "debug.h"
+#include "execution_p.h"
+#include "executor_p.h"
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+using namespace KAsync;
+using namespace KAsync::Private;
+
+std::atomic<bool> KAsync::Private::tracingEnabled{false};
+std::atomic<bool> KAsync::Private::statsEnabled{false};
+
+namespace {
+
+// The callbacks are read with std::atomic_load() by the executions, the
+// mutexes only serialize setting them along with the enabled flags
+QMutex sCallbackMutex;
+std::shared_ptr<const TraceCallback> sCallback;
+
+QMutex sStatsCallbackMutex;
+std::shared_ptr<const StepStatsCallback> sStatsCallback;
+std::atomic<AllocationCounter> sAllocationCounter{nullptr};
+
+std::atomic<quint64> sLastExecutionId{0};
+thread_local quint64 tCurrentExecutionId = 0;
+
+qint64 now()
+{
+    const auto time = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+void emitEvent(TraceEvent::Type type, const Execution *execution)
+{
+    const auto callback = std::atomic_load(&sCallback);
+    if (!callback) {
+        return;
+    }
+    (*callback)(TraceEvent{type,
+                           execution->instrumentation->traceId,
+                           execution->instrumentation->traceParentId,
+                           execution->executor->executorName(),
+                           now(),
+                           QThread::currentThreadId()});
+}
+
+} // namespace
+
+void KAsync::setTraceCallback(TraceCallback callback)
+{
+    QMutexLocker locker(&sCallbackMutex);
+    const bool enabled = static_cast<bool>(callback);
+    std::atomic_store(&sCallback, enabled ? std::make_shared<const TraceCallback>(std::move(callback))
+                                          : std::shared_ptr<const TraceCallback>());
+    tracingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void KAsync::Private::traceSetup(Execution *execution)
+{
+    execution->instrument().traceParentId = tCurrentExecutionId;
+}
+
+void KAsync::Private::traceBegin(Execution *execution)
+{
+    execution->instrument().traceId = ++sLastExecutionId;
+    emitEvent(TraceEvent::Begin, execution);
+}
+
+void KAsync::Private::traceEnd(Execution *execution)
+{
+    emitEvent(TraceEvent::End, execution);
+    execution->instrumentation->traceId = 0;
+}
+
+void KAsync::setStepStatsCallback(StepStatsCallback callback)
+{
+    QMutexLocker locker(&sStatsCallbackMutex);
+    const bool enabled = static_cast<bool>(callback);
+    std::atomic_store(&sStatsCallback, enabled ? std::make_shared<const StepStatsCallback>(std::move(callback))
+                                               : std::shared_ptr<const StepStatsCallback>());
+    statsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void KAsync::setAllocationCounter(AllocationCounter counter)
+{
+    sAllocationCounter.store(counter, std::memory_order_relaxed);
+}
+
+void KAsync::Private::statsReady(Execution *execution)
+{
+    execution->instrument().statsReadyTime = now();
+}
+
+void KAsync::Private::statsBegin(Execution *execution)
+{
+    auto &instrumentation = execution->instrument();
+    instrumentation.statsStart = now();
+    if (!instrumentation.statsReadyTime) {
+        // Statistics were turned on while the previous step was running
+        instrumentation.statsReadyTime = instrumentation.statsStart;
+    }
+    if (const auto counter = sAllocationCounter.load(std::memory_order_relaxed)) {
+        instrumentation.statsAllocationStart = static_cast<qint64>(counter());
+    }
+    instrumentation.statsThread.store(QThread::currentThreadId(), std::memory_order_relaxed);
+    instrumentation.statsRunning.store(true, std::memory_order_release);
+}
+
+void KAsync::Private::statsReturned(Execution *execution)
+{
+    // Only one of the running thread returning and the step finishing in
+    // it measures the allocations
+    auto &instrumentation = *execution->instrumentation;
+    if (!instrumentation.statsRunning.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    if (const auto counter = sAllocationCounter.load(std::memory_order_relaxed)) {
+        instrumentation.statsAllocated.store(static_cast<qint64>(counter()) - instrumentation.statsAllocationStart,
+                                             std::memory_order_relaxed);
+    }
+}
+
+void KAsync::Private::statsEnd(Execution *execution)
+{
+    const qint64 end = now();
+    // A step finishing within its continuation is measured up to here,
+    // only the running thread can tell and its counter is the right one
+    auto &instrumentation = *execution->instrumentation;
+    const Qt::HANDLE thread = instrumentation.statsThread.load(std::memory_order_relaxed);
+    if (thread == QThread::currentThreadId()) {
+        statsReturned(execution);
+    }
+    const auto callback = std::atomic_load(&sStatsCallback);
+    if (callback) {
+        (*callback)(StepStats{execution->executor->executorName(),
+                              instrumentation.statsStart - instrumentation.statsReadyTime,
+                              end - instrumentation.statsStart,
+                              instrumentation.statsAllocated.load(std::memory_order_relaxed),
+                              thread});
+    }
+    instrumentation.statsStart = 0;
+}
+
+TraceScope::TraceScope(Execution *execution)
+    : mOuter(tCurrentExecutionId)
+{
+    tCurrentExecutionId = execution->instrumentation->traceId;
+}
+
+TraceScope::~TraceScope()
+{
+    tCurrentExecutionId = mOuter;
+}
+
+
+struct ChromeTraceRecorder::Private
+{
+    mutable QMutex mutex;
+    QVector<TraceEvent> events;
+};
+
+ChromeTraceRecorder::ChromeTraceRecorder()
+    : d(std::make_shared<Private>())
+{
+    // The callback holds the data, so that events of steps finishing while
+    // the recorder is being destroyed don't access freed memory.
+    setTraceCallback([d = d](const TraceEvent &event) {
+        QMutexLocker locker(&d->mutex);
+        d->events.push_back(event);
+    });
+}
+
+ChromeTraceRecorder::~ChromeTraceRecorder()
+{
+    setTraceCallback({});
+}
+
+QByteArray ChromeTraceRecorder::toJson() const
+{
+    QMutexLocker locker(&d->mutex);
+
+    // Demangle each executor type only once
+    QHash<const char *, QByteArray> names;
+    QHash<Qt::HANDLE, int> threads;
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QByteArray json("{\"traceEvents\":[");
+    bool first = true;
+    for (const auto &event : qAsConst(d->events)) {
+        auto name = names.find(event.name);
+        if (name == names.end()) {
+            name = names.insert(event.name, demangleName(event.name).toUtf8()
+                                               .replace('\\', "\\\\").replace('"', "\\\""));
+        }
+        auto tid = threads.find(event.threadId);
+        if (tid == threads.end()) {
+            tid = threads.insert(event.threadId, threads.size() + 1);
+        }
+
+        if (!first) {
+            json += ',';
+        }
+        first = false;
+        json += "\n{\"name\":\"" + *name
+              + "\",\"cat\":\"kasync\",\"ph\":\"" + (event.type == TraceEvent::Begin ? "b" : "e")
+              + "\",\"id\":" + QByteArray::number(event.executionId)
+              + ",\"ts\":" + QByteArray::number(event.timestamp / 1000.0, 'f', 3)
+              + ",\"pid\":" + QByteArray::number(pid)
+              + ",\"tid\":" + QByteArray::number(*tid)
+              + ",\"args\":{\"parent\":" + QByteArray::number(event.parentId) + "}}";
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+bool ChromeTraceRecorder::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    return file.write(toJson()) != -1;
+}
@@ -0,0 +1,213 @@
+/*
+    SPDX-FileCopyrightText: 2026 KAsync contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KASYNC_TRACE_H
+#define KASYNC_TRACE_H
+
+#include "kasync_export.h"
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class QByteArray;
+class QString;
+
+namespace KAsync {
+
+/**
+ * @ingroup Trace
+ *
+ * @brief A step of a job that started or finished running.
+ *
+ * Every step of an execution is reported once with the Begin type, right
+ * before its continuation is invoked, and once with the End type, when its
+ * future has finished. Steps that are skipped, for example because the
+ * previous step failed, are not reported.
+ */
+struct TraceEvent
+{
+    enum Type {
+        Begin,
+        End
+    };
+
+    Type type;
+    /// Identifies the step, unique within the process
+    quint64 executionId;
+    /// The step that was running when the job of this step was executed, or 0
+    quint64 parentId;
+    /// Mangled name of the executor type, see KAsync::demangleName()
+    const char *name;
+    /// Monotonic time in nanoseconds
+    qint64 timestamp;
+    Qt::HANDLE threadId;
+};
+
+using TraceCallback = std::function<void(const TraceEvent &)>;
+
+/**
+ * @ingroup Trace
+ *
+ * Installs @p callback to receive the TraceEvents of all executions in the
+ * process, replacing the previous one. Passing an empty callback turns the
+ * tracing off, which is the default.
+ *
+ * The callback is invoked from the threads running the steps, so it must be
+ * thread-safe. Steps that are already running when the callback is installed
+ * are not reported.
+ */
+KASYNC_EXPORT void setTraceCallback(TraceCallback callback);
+
+/**
+ * @ingroup Trace
+ *
+ * @brief Records the TraceEvents in the Chrome trace event format.
+ *
+ * The recorder installs itself with setTraceCallback() while it exists. The
+ * recorded steps can be saved and loaded into chrome://tracing or Perfetto,
+ * where each step is shown as an async slice named after its executor.
+ *
+ * @code
+ * KAsync::ChromeTraceRecorder recorder;
+ * job.exec().waitForFinished();
+ * recorder.save(QStringLiteral("job.json"));
+ * @endcode
+ */
+class KASYNC_EXPORT ChromeTraceRecorder
+{
+public:
+    ChromeTraceRecorder();
+    ~ChromeTraceRecorder();
+
+    /**
+     * Returns the steps recorded so far as a JSON trace.
+     */
+    QByteArray toJson() const;
+
+    /**
+     * Writes the JSON trace to @p fileName, returns false if the file could
+     * not be written.
+     */
+    bool save(const QString &fileName) const;
+
+private:
+    struct Private;
+    std::shared_ptr<Private> d;
+};
+
+/**
+ * @ingroup Trace
+ *
+ * @brief Where the time and memory of a finished step went.
+ *
+ * Tells apart steps that wait for their input from steps that are busy
+ * themselves. A long queueWait means the step was ready, but the thread
+ * didn't get to it, for example because the event loop was blocked. A long
+ * runTime means the step itself took long to finish.
+ *
+ * @see setStepStatsCallback()
+ */
+struct StepStats
+{
+    /// Mangled name of the executor type, see KAsync::demangleName()
+    const char *name;
+    /// Nanoseconds from the previous step finishing, or exec(), to this step starting
+    qint64 queueWait;
+    /// Nanoseconds from this step starting to its future finishing
+    qint64 runTime;
+    /**
+     * Bytes allocated by the thread running the continuation of the step
+     * until it returned, or until the step finished if that happened first.
+     * Allocations of asynchronous work in other threads are not included.
+     * -1 without an allocation counter, see setAllocationCounter().
+     */
+    qint64 allocatedBytes;
+    /// The thread that started the step
+    Qt::HANDLE threadId;
+};
+
+using StepStatsCallback = std::function<void(const StepStats &)>;
+
+/**
+ * @ingroup Trace
+ *
+ * Installs @p callback to receive the StepStats of every step once it has
+ * finished, replacing the previous one. Passing an empty callback turns the
+ * statistics off, which is the default.
+ *
+ * The callback is invoked from the thread finishing the step, so it must be
+ * thread-safe. Steps that are skipped, for example because the previous step
+ * failed, are not reported.
+ */
+KASYNC_EXPORT void setStepStatsCallback(StepStatsCallback callback);
+
+/**
+ * Returns the number of bytes allocated by the current thread so far.
+ */
+using AllocationCounter = quint64 (*)();
+
+/**
+ * @ingroup Trace
+ *
+ * Installs @p counter to measure StepStats::allocatedBytes. KAsync doesn't
+ * track allocations itself, the counter is usually provided by the allocator,
+ * or by replacing the global operator new:
+ *
+ * @code
+ * thread_local quint64 allocated = 0;
+ *
+ * void *operator new(std::size_t size)
+ * {
+ *     allocated += size;
+ *     ...
+ * }
+ *
+ * KAsync::setAllocationCounter([]() { return allocated; });
+ * @endcode
+ */
+KASYNC_EXPORT void setAllocationCounter(AllocationCounter counter);
+
+//@cond PRIVATE
+namespace Private {
+
+struct Execution;
+
+KASYNC_EXPORT extern std::atomic<bool> tracingEnabled;
+
+// Gives @p execution its parent, the step running in the current thread
+KASYNC_EXPORT void traceSetup(Execution *execution);
+KASYNC_EXPORT void traceBegin(Execution *execution);
+KASYNC_EXPORT void traceEnd(Execution *execution);
+
+KASYNC_EXPORT extern std::atomic<bool> statsEnabled;
+
+// The previous step of @p execution has finished, or it is the first one
+KASYNC_EXPORT void statsReady(Execution *execution);
+// Around the invocation of the continuation of @p execution
+KASYNC_EXPORT void statsBegin(Execution *execution);
+KASYNC_EXPORT void statsReturned(Execution *execution);
+KASYNC_EXPORT void statsEnd(Execution *execution);
+
+// Makes @p execution the step running in the current thread while it exists
+class KASYNC_EXPORT TraceScope
+{
+public:
+    explicit TraceScope(Execution *execution);
+    ~TraceScope();
+
+private:
+    quint64 mOuter;
+};
+
+} // namespace Private
+//@endcond
+
+} // namespace KAsync
+
+#endif // KASYNC_TRACE_H